@@ -0,0 +1,263 @@
+// Synthetic layout generator for the benchmark suite.
+//
+// Usage: gen_layout --blocks <n> [--dist uniform|clustered|strips|grid]
+//                   [--mix points|interleaved|areas|churn] [--queries <q>]
+//                   [--seed <s>] [-o <file>]
+//
+// The outline is cut into a grid of cells and every block is drawn inside
+// a cell of its own, so blocks never overlap however many are asked for.
+// The distribution decides the cell shape and which cells are used:
+//   uniform    a random 80% of a square grid
+//   clustered  cells drawn around a few Gaussian centres, 25% fill overall
+//   strips     long horizontal strips one to four units high
+//   grid       every cell, identical blocks, inserted row by row
+// The query mix decides what follows the blocks:
+//   points       q random P queries after the last block
+//   interleaved  one P query every 64 blocks, then q more
+//   areas        q A windows of a few cells each
+//   churn        q blocks deleted and inserted again, then q P queries
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+
+struct Layout
+{
+    int cell_width;
+    int cell_height;
+    long long columns;
+    long long rows;
+};
+
+struct Block
+{
+    int x;
+    int y;
+    int w;
+    int h;
+};
+
+class Generator {
+private:
+    std::mt19937_64 rng;
+    std::string buffer;
+    FILE* out;
+
+    long long uniform(long long low, long long high) {
+        return std::uniform_int_distribution<long long>(low, high)(rng);
+    }
+
+    void flush(bool force) {
+        if (force || buffer.size() >= (size_t(1) << 22)) {
+            fwrite(buffer.data(), 1, buffer.size(), out);
+            buffer.clear();
+        }
+    }
+
+    void line(std::initializer_list<long long> values, const char* prefix) {
+        buffer += prefix;
+        bool first = *prefix == '\0';
+        for (long long value : values) {
+            if (!first) {
+                buffer += ' ';
+            }
+            buffer += std::to_string(value);
+            first = false;
+        }
+        buffer += '\n';
+        flush(false);
+    }
+
+    // Random block inside cell `cell` of the layout
+    Block blockInCell(const Layout& layout, long long cell, bool strips) {
+        int cx = int(cell % layout.columns) * layout.cell_width;
+        int cy = int(cell / layout.columns) * layout.cell_height;
+        int dx, w;
+        if (strips) {
+            dx = int(uniform(0, layout.cell_width / 8 - 1));
+            w = int(uniform(layout.cell_width / 2, layout.cell_width - dx));
+        } else {
+            dx = int(uniform(0, layout.cell_width / 2 - 1));
+            w = int(uniform(1, layout.cell_width - dx));
+        }
+        int dy = int(uniform(0, layout.cell_height / 2 - 1));
+        int h = int(uniform(1, layout.cell_height - dy));
+        return {cx + dx, cy + dy, w, h};
+    }
+
+public:
+    Generator(unsigned long long seed, FILE* out): rng(seed), out(out) {}
+
+    bool run(long long blocks, const std::string& dist, const std::string& mix, long long queries) {
+        // Cell grid and the cells that receive a block, in insertion order
+        Layout layout = {32, 32, 0, 0};
+        double fill = 0.8;
+        if (dist == "clustered") {
+            fill = 0.25;
+        } else if (dist == "strips") {
+            layout.cell_width = 512;
+            layout.cell_height = 4;
+        } else if (dist == "grid") {
+            fill = 1.0;
+        } else if (dist != "uniform") {
+            return false;
+        }
+        long long cells = std::max(blocks, (long long)std::ceil(blocks / fill));
+        double aspect = double(layout.cell_width) / layout.cell_height;
+        layout.columns = std::max(1LL, (long long)std::ceil(std::sqrt(cells / aspect)));
+        layout.rows = (cells + layout.columns - 1) / layout.columns;
+        long long width = layout.columns * layout.cell_width;
+        long long height = layout.rows * layout.cell_height;
+        if (width > 2000000000LL || height > 2000000000LL) {
+            return false;
+        }
+
+        std::vector<long long> chosen;
+        chosen.reserve(blocks);
+        if (dist == "grid") {
+            for (long long cell = 0; cell < blocks; cell++) {
+                chosen.push_back(cell);
+            }
+        } else if (dist == "clustered") {
+            std::vector<bool> taken(layout.columns * layout.rows, false);
+            long long centres = std::max(1LL, blocks / 5000);
+            double sigma = std::max(1.0, std::sqrt(double(blocks) / centres) * 0.6);
+            std::vector<std::pair<double, double>> centre(centres);
+            for (std::pair<double, double>& c : centre) {
+                c = {double(uniform(0, layout.columns - 1)), double(uniform(0, layout.rows - 1))};
+            }
+            std::normal_distribution<double> spread(0.0, sigma);
+            while ((long long)chosen.size() < blocks) {
+                const std::pair<double, double>& c = centre[uniform(0, centres - 1)];
+                long long col = (long long)std::floor(c.first + spread(rng));
+                long long row = (long long)std::floor(c.second + spread(rng));
+                if (col < 0 || col >= layout.columns || row < 0 || row >= layout.rows) {
+                    continue;
+                }
+                long long cell = row * layout.columns + col;
+                if (!taken[cell]) {
+                    taken[cell] = true;
+                    chosen.push_back(cell);
+                }
+            }
+        } else {
+            // Selection sampling of `blocks` out of `cells`, then shuffled
+            long long needed = blocks;
+            for (long long cell = 0; cell < cells && needed > 0; cell++) {
+                if (uniform(0, cells - cell - 1) < needed) {
+                    chosen.push_back(cell);
+                    needed--;
+                }
+            }
+            std::shuffle(chosen.begin(), chosen.end(), rng);
+        }
+
+        line({width, height}, "");
+        bool strips = dist == "strips";
+        std::vector<Block> placed;
+        placed.reserve(blocks);
+        for (long long i = 0; i < blocks; i++) {
+            Block block;
+            if (dist == "grid") {
+                long long cell = chosen[i];
+                block = {int(cell % layout.columns) * layout.cell_width + 4, int(cell / layout.columns) * layout.cell_height + 4,
+                         layout.cell_width - 8, layout.cell_height - 8};
+            } else {
+                block = blockInCell(layout, chosen[i], strips);
+            }
+            placed.push_back(block);
+            line({i + 1, block.x, block.y, block.w, block.h}, "");
+            if (mix == "interleaved" && i % 64 == 63) {
+                line({uniform(0, width - 1), uniform(0, height - 1)}, "P ");
+            }
+        }
+
+        if (mix == "points" || mix == "interleaved") {
+            for (long long q = 0; q < queries; q++) {
+                line({uniform(0, width - 1), uniform(0, height - 1)}, "P ");
+            }
+        } else if (mix == "areas") {
+            for (long long q = 0; q < queries; q++) {
+                long long w = uniform(1, 4LL * layout.cell_width);
+                long long h = uniform(1, 4LL * layout.cell_height);
+                line({uniform(0, width - 1), uniform(0, height - 1), w, h}, "A ");
+            }
+        } else if (mix == "churn") {
+            for (long long q = 0; q < queries && blocks > 0; q++) {
+                long long id = uniform(1, blocks);
+                const Block& block = placed[id - 1];
+                line({id}, "D ");
+                line({id, block.x, block.y, block.w, block.h}, "");
+            }
+            for (long long q = 0; q < queries; q++) {
+                line({uniform(0, width - 1), uniform(0, height - 1)}, "P ");
+            }
+        } else {
+            return false;
+        }
+        flush(true);
+        return true;
+    }
+};
+
+int main(int argc, char const *argv[]) {
+    long long blocks = -1;
+    long long queries = -1;
+    std::string dist = "uniform";
+    std::string mix = "points";
+    unsigned long long seed = 1;
+    std::string path;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            blocks = -1;
+            break;
+        }
+        if (arg == "--blocks") {
+            blocks = std::atoll(argv[++i]);
+        } else if (arg == "--queries") {
+            queries = std::atoll(argv[++i]);
+        } else if (arg == "--dist") {
+            dist = argv[++i];
+        } else if (arg == "--mix") {
+            mix = argv[++i];
+        } else if (arg == "--seed") {
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-o") {
+            path = argv[++i];
+        } else {
+            blocks = -1;
+            break;
+        }
+    }
+    if (blocks < 1) {
+        std::cerr << "Usage: " << argv[0] << " --blocks <n> [--dist uniform|clustered|strips|grid]"
+                  << " [--mix points|interleaved|areas|churn] [--queries <q>] [--seed <s>] [-o <file>]" << std::endl;
+        return 1;
+    }
+    if (queries < 0) {
+        queries = blocks;
+    }
+
+    FILE* out = path.empty() ? stdout : fopen(path.c_str(), "w");
+    if (out == nullptr) {
+        std::cerr << "Error: Unable to open " << path << std::endl;
+        return 1;
+    }
+    Generator generator(seed, out);
+    if (!generator.run(blocks, dist, mix, queries)) {
+        std::cerr << "Error: Unknown distribution or query mix, or the layout does not fit in int coordinates" << std::endl;
+        return 1;
+    }
+    if (out != stdout && fclose(out) != 0) {
+        std::cerr << "Error: Unable to write " << path << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,39 @@
+#!/bin/sh
+# Cache behaviour of tile compaction.
+#
+# Runs Lab1 on one layout twice, with and without --no-compact, under
+# `perf stat` and prints the cache references and misses of each run next
+# to its --timings line. Without perf (or without permission to read the
+# counters) only the timings are printed.
+#   bench/perf_compact.sh [layout] [extra Lab1 options]
+# The default layout is the churn mix of 10^6 blocks, generated on first
+# use like run_bench.sh does. LAB1 names the binary to run, as for
+# run_bench.sh.
+
+set -e
+
+cd "$(dirname "$0")/.."
+
+OUT=bench/out
+LAYOUT=${1:-$OUT/uniform-churn-1000000.txt}
+LAB1=${LAB1:-./Lab1}
+[ $# -gt 0 ] && shift
+
+mkdir -p "$OUT"
+if [ ! -f "$LAYOUT" ]; then
+    bench/gen_layout --blocks 1000000 --dist uniform --mix churn -o "$LAYOUT"
+fi
+
+PERF=""
+if command -v perf >/dev/null 2>&1 && perf stat -e cache-misses true >/dev/null 2>&1; then
+    PERF="perf stat -x , -e cache-references,cache-misses"
+fi
+
+for flag in "" --no-compact; do
+    # shellcheck disable=SC2086
+    report=$($PERF "$LAB1" --timings $flag "$@" "$LAYOUT" "$OUT/perf_compact.out" 2>&1 >/dev/null)
+    echo "${flag:-compact}: $(echo "$report" | grep '^{' | tail -n 1)"
+    if [ -n "$PERF" ]; then
+        echo "$report" | grep ',cache-' | awk -F , '{ printf "    %s %s\n", $3, $1 }'
+    fi
+done
@@ -0,0 +1,55 @@
+#!/bin/sh
+# Benchmark driver for `make bench`.
+#
+# Generates one layout per (size, distribution, query mix), runs Lab1 on it
+# with --timings and appends one JSON object per run to bench/out/results.jsonl.
+# The sets can be overridden from the environment, e.g.
+#   BENCH_SIZES="10000 10000000" BENCH_DISTS=strips make bench
+# BENCH_COORDS="16 32 64" repeats every run with each coordinate width
+# (--coord); widths too narrow for a layout are skipped.
+# Generated layouts are kept in bench/out and reused by later runs.
+# LAB1 names the binary to time; make bench sets it to the optimized
+# bench/Lab1.
+
+set -e
+
+cd "$(dirname "$0")/.."
+
+SIZES=${BENCH_SIZES:-"10000 100000 1000000"}
+DISTS=${BENCH_DISTS:-"uniform clustered strips grid"}
+MIXES=${BENCH_MIXES:-"points interleaved areas churn"}
+FLAGS=${BENCH_FLAGS:-""}
+COORDS=${BENCH_COORDS:-"auto"}
+LAB1=${LAB1:-./Lab1}
+OUT=bench/out
+
+mkdir -p "$OUT"
+RESULTS="$OUT/results.jsonl"
+: > "$RESULTS"
+
+for size in $SIZES; do
+    for dist in $DISTS; do
+        for mix in $MIXES; do
+            name="$dist-$mix-$size"
+            layout="$OUT/$name.txt"
+            if [ ! -f "$layout" ]; then
+                bench/gen_layout --blocks "$size" --dist "$dist" --mix "$mix" -o "$layout"
+            fi
+            for coord in $COORDS; do
+                coord_flag=""
+                if [ "$coord" != auto ]; then
+                    coord_flag="--coord $coord"
+                fi
+                # shellcheck disable=SC2086
+                timing=$("$LAB1" --timings $coord_flag $FLAGS "$layout" "$OUT/$name.out" 2>&1 >/dev/null | tail -n 1)
+                case "$timing" in
+                    "{"*) ;;
+                    *) echo "skipping $name with --coord $coord: $timing" >&2; continue ;;
+                esac
+                line="{\"layout\": \"$name\", \"dist\": \"$dist\", \"mix\": \"$mix\", \"size\": $size, \"coord\": \"$coord\", \"run\": $timing}"
+                echo "$line"
+                echo "$line" >> "$RESULTS"
+            done
+        done
+    done
+done
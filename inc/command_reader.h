@@ -0,0 +1,329 @@
+#ifndef _COMMAND_READER_H
+#define _COMMAND_READER_H
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstddef>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tile.h"
+
+
+struct Command
+{
+    enum Type {
+        BLOCK,      // id x y w h
+        POINT,      // P x y
+        DELETE,     // D id
+        AREA,       // A x y w h
+        LAYER,      // L layer
+        CROSS,      // X x y
+    } type;
+    int id;
+    // Coordinates are read at full width; the Outline narrows them to its
+    // own coordinate type.
+    BasicRect<long long> rect;
+    BasicPoint<long long> point;
+};
+
+// Streaming reader for the command format. Regular files are mapped into
+// memory; anything else (stdin, pipes) is read in large chunks, so the
+// reader holds at most one chunk plus one partial line at a time. Numbers
+// are scanned by hand instead of through locale-aware streams.
+//
+// Every method that can fail returns false and leaves a message with the
+// offending line number in error().
+class CommandReader {
+private:
+    static const size_t CHUNK_SIZE = size_t(1) << 20;
+
+    int fd;
+    bool mapped;
+    const char* map_begin;
+    size_t map_size;
+    std::vector<char> buffer;
+    bool eof;
+
+    const char* cur;
+    const char* end;
+    const char* query_tail;
+    size_t line_number;
+    std::string error_message;
+
+    bool fail(const std::string& message) {
+        error_message = "line " + std::to_string(line_number) + ": " + message;
+        return false;
+    }
+
+    // Makes sure [cur, end) holds a whole line, or the rest of the input.
+    void fill() {
+        if (mapped || eof || std::memchr(cur, '\n', end - cur) != nullptr) {
+            return;
+        }
+        size_t kept = end - cur;
+        std::memmove(buffer.data(), cur, kept);
+        for (;;) {
+            if (buffer.size() - kept < CHUNK_SIZE / 2) {
+                buffer.resize(buffer.size() * 2);
+            }
+            ssize_t got = ::read(fd, buffer.data() + kept, buffer.size() - kept);
+            if (got <= 0) {
+                eof = true;
+                break;
+            }
+            bool has_newline = std::memchr(buffer.data() + kept, '\n', got) != nullptr;
+            kept += got;
+            if (has_newline) {
+                break;
+            }
+        }
+        cur = buffer.data();
+        end = cur + kept;
+    }
+
+    static bool isBlank(char c) {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    void skipBlanks(const char*& it, const char* line_end) {
+        while (it < line_end && isBlank(*it)) {
+            it++;
+        }
+    }
+
+    // Numbers are read as 64-bit values limited to 2^62, so that x + w
+    // of two coordinates cannot overflow
+    bool scanCoord(const char*& it, const char* line_end, long long& value) {
+        skipBlanks(it, line_end);
+        bool negative = false;
+        if (it < line_end && (*it == '-' || *it == '+')) {
+            negative = *it == '-';
+            it++;
+        }
+        if (it == line_end || *it < '0' || *it > '9') {
+            return fail("expected an integer");
+        }
+        long long magnitude = 0;
+        while (it < line_end && *it >= '0' && *it <= '9') {
+            magnitude = magnitude * 10 + (*it - '0');
+            if (magnitude > (1LL << 62)) {
+                return fail("integer out of range");
+            }
+            it++;
+        }
+        value = negative ? -magnitude : magnitude;
+        return true;
+    }
+
+    bool scanInt(const char*& it, const char* line_end, int& value) {
+        long long wide;
+        if (!scanCoord(it, line_end, wide)) {
+            return false;
+        }
+        if (wide < -2147483648LL || wide > 2147483647LL) {
+            return fail("integer out of range");
+        }
+        value = int(wide);
+        return true;
+    }
+
+    bool expectLineEnd(const char*& it, const char* line_end) {
+        skipBlanks(it, line_end);
+        if (it != line_end) {
+            return fail("unexpected trailing characters");
+        }
+        return true;
+    }
+
+    // Next non-blank line as [line_begin, line_end); false at end of input.
+    bool nextLine(const char*& line_begin, const char*& line_end) {
+        for (;;) {
+            fill();
+            if (cur == end) {
+                return false;
+            }
+            const char* newline = static_cast<const char*>(std::memchr(cur, '\n', end - cur));
+            line_begin = cur;
+            line_end = newline == nullptr ? end : newline;
+            cur = newline == nullptr ? end : newline + 1;
+            line_number++;
+
+            const char* it = line_begin;
+            skipBlanks(it, line_end);
+            if (it != line_end) {
+                return true;
+            }
+        }
+    }
+
+    // Start of the trailing run of P lines in a mapped file.
+    void findQueryTail() {
+        query_tail = end;
+        const char* line_end = end;
+        while (line_end > cur) {
+            const char* line_begin = line_end;
+            while (line_begin > cur && line_begin[-1] != '\n') {
+                line_begin--;
+            }
+            const char* first = line_begin;
+            skipBlanks(first, line_end);
+            if (first < line_end && *first != 'P') {
+                return;
+            }
+            query_tail = line_begin;
+            line_end = line_begin == cur ? cur : line_begin - 1;
+        }
+    }
+
+public:
+    //================================================================
+    // Constructors and Destructors
+    //================================================================
+    CommandReader(): fd(-1), mapped(false), map_begin(nullptr), map_size(0), eof(false),
+                     cur(nullptr), end(nullptr), query_tail(nullptr), line_number(0) {}
+    ~CommandReader() {
+        if (mapped) {
+            munmap(const_cast<char*>(map_begin), map_size);
+        }
+        if (fd > 0) {
+            ::close(fd);
+        }
+    }
+    CommandReader(const CommandReader&) = delete;
+    CommandReader& operator=(const CommandReader&) = delete;
+
+    //================================================================
+    // Getters and Setters
+    //================================================================
+    const std::string& error() const {
+        return error_message;
+    }
+
+    size_t getLineNumber() const {
+        return line_number;
+    }
+
+    // True once every remaining command is a P query. Only known for
+    // mapped files; streamed input always answers false.
+    bool inQueryTail() const {
+        return query_tail != nullptr && cur >= query_tail;
+    }
+
+    //================================================================
+    // Public Methods
+    //================================================================
+    // An empty path reads stdin.
+    bool open(const std::string& path) {
+        fd = path.empty() ? 0 : ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            error_message = "unable to open " + path;
+            return false;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED) {
+                madvise(map, st.st_size, MADV_SEQUENTIAL);
+                mapped = true;
+                map_begin = static_cast<const char*>(map);
+                map_size = st.st_size;
+                cur = map_begin;
+                end = map_begin + map_size;
+                findQueryTail();
+                return true;
+            }
+        }
+
+        buffer.resize(CHUNK_SIZE);
+        cur = end = buffer.data();
+        return true;
+    }
+
+    bool readOutline(long long& width, long long& height) {
+        const char* line_begin;
+        const char* line_end;
+        if (!nextLine(line_begin, line_end)) {
+            line_number++;
+            return fail("missing outline size");
+        }
+        return scanCoord(line_begin, line_end, width)
+            && scanCoord(line_begin, line_end, height)
+            && expectLineEnd(line_begin, line_end);
+    }
+
+    // Returns false at the end of input or on a malformed line; error()
+    // is empty in the first case.
+    bool next(Command& command) {
+        const char* it;
+        const char* line_end;
+        if (!nextLine(it, line_end)) {
+            return false;
+        }
+        return parseLine(it, line_end, command);
+    }
+
+    // Parses one non-blank line that did not come from this reader's
+    // input, e.g. a server request. Errors name `line_number`.
+    bool parseLine(const char* it, const char* line_end, size_t line, Command& command) {
+        line_number = line;
+        return parseLine(it, line_end, command);
+    }
+
+    bool parseLine(const char* it, const char* line_end, Command& command) {
+        skipBlanks(it, line_end);
+
+        if (*it == 'P') {
+            it++;
+            command.type = Command::POINT;
+            return scanCoord(it, line_end, command.point.x)
+                && scanCoord(it, line_end, command.point.y)
+                && expectLineEnd(it, line_end);
+        }
+
+        if (*it == 'X') {
+            it++;
+            command.type = Command::CROSS;
+            return scanCoord(it, line_end, command.point.x)
+                && scanCoord(it, line_end, command.point.y)
+                && expectLineEnd(it, line_end);
+        }
+
+        if (*it == 'L') {
+            it++;
+            command.type = Command::LAYER;
+            return scanInt(it, line_end, command.id)
+                && expectLineEnd(it, line_end);
+        }
+
+        if (*it == 'D') {
+            it++;
+            command.type = Command::DELETE;
+            return scanInt(it, line_end, command.id)
+                && expectLineEnd(it, line_end);
+        }
+
+        long long x, y, w, h;
+        if (*it == 'A') {
+            it++;
+            command.type = Command::AREA;
+        } else {
+            command.type = Command::BLOCK;
+            if (!scanInt(it, line_end, command.id)) {
+                return false;
+            }
+        }
+        if (!scanCoord(it, line_end, x) || !scanCoord(it, line_end, y)
+            || !scanCoord(it, line_end, w) || !scanCoord(it, line_end, h)
+            || !expectLineEnd(it, line_end)) {
+            return false;
+        }
+        command.rect = {{x + w, y + h}, {x, y}};
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef _DENSITY_MAP_H
+#define _DENSITY_MAP_H
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include "output_writer.h"
+
+
+// Binary density map: the header, then the utilization, tile and space
+// matrices as float32, each `rows` rows of `columns` values from the
+// bottom row up. Fields are in host byte order, as in a snapshot.
+const char DENSITY_MAP_MAGIC[8] = {'L', 'A', 'B', '1', 'D', 'M', 'A', 'P'};
+const uint32_t DENSITY_MAP_VERSION = 1;
+const uint32_t DENSITY_MAP_BYTE_ORDER = 0x01020304;
+
+struct DensityMapHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t columns;
+    uint32_t rows;
+    int64_t width;
+    int64_t height;
+};
+
+// Per-bin maps of an outline cut into `columns` x `rows` equal bins:
+//   utilization  fraction of the bin covered by blocks
+//   tiles        tiles in the bin, each counted by the share of its area
+//                that lies in the bin
+//   space        the same for space tiles only (fragmentation)
+// A tile counts 1 in total, so the tiles map of the whole outline sums to
+// the number of tiles. Bin (column, row) is at index row * columns +
+// column, row 0 at the bottom.
+class DensityMap {
+private:
+    int columns;
+    int rows;
+    long long width;
+    long long height;
+    std::vector<float> utilization;
+    std::vector<float> tiles;
+    std::vector<float> space;
+
+    static bool writeMatrix(const std::string& path, int columns, int rows, const std::vector<float>& values) {
+        OutputWriter output;
+        if (!output.open(path, false)) {
+            return false;
+        }
+        char number[32];
+        std::string line;
+        for (int row = 0; row < rows; row++) {
+            line.clear();
+            for (int column = 0; column < columns; column++) {
+                if (column) {
+                    line += ',';
+                }
+                line.append(number, std::snprintf(number, sizeof(number), "%.6g", values[size_t(row) * columns + column]));
+            }
+            line += '\n';
+            output.write(line);
+        }
+        return output.close();
+    }
+
+public:
+    //================================================================
+    // Constructors and Destructors
+    //================================================================
+    DensityMap(int columns, int rows, long long width, long long height):
+        columns(columns), rows(rows), width(width), height(height),
+        utilization(size_t(columns) * rows, 0.0f), tiles(size_t(columns) * rows, 0.0f), space(size_t(columns) * rows, 0.0f) {}
+
+    //================================================================
+    // Getters and Setters
+    //================================================================
+    int getColumns() const {
+        return columns;
+    }
+
+    int getRows() const {
+        return rows;
+    }
+
+    std::vector<float>& getUtilization() {
+        return utilization;
+    }
+
+    std::vector<float>& getTiles() {
+        return tiles;
+    }
+
+    std::vector<float>& getSpace() {
+        return space;
+    }
+
+    //================================================================
+    // Public Methods
+    //================================================================
+    // One CSV matrix per map, next to each other: "map.csv" is written as
+    // map_utilization.csv, map_tiles.csv and map_space.csv. Rows go from
+    // the bottom of the outline up.
+    bool writeCSV(const std::string& path) const {
+        size_t dot = path.rfind('.');
+        if (dot == std::string::npos || path.find('/', dot) != std::string::npos) {
+            dot = path.size();
+        }
+        std::string stem = path.substr(0, dot);
+        std::string extension = path.substr(dot);
+        return writeMatrix(stem + "_utilization" + extension, columns, rows, utilization)
+            && writeMatrix(stem + "_tiles" + extension, columns, rows, tiles)
+            && writeMatrix(stem + "_space" + extension, columns, rows, space);
+    }
+
+    bool writeBinary(const std::string& path) const {
+        DensityMapHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, DENSITY_MAP_MAGIC, sizeof(header.magic));
+        header.version = DENSITY_MAP_VERSION;
+        header.byte_order = DENSITY_MAP_BYTE_ORDER;
+        header.columns = columns;
+        header.rows = rows;
+        header.width = width;
+        header.height = height;
+
+        OutputWriter output;
+        if (!output.open(path, false)) {
+            return false;
+        }
+        output.write(std::string(reinterpret_cast<const char*>(&header), sizeof(header)));
+        for (const std::vector<float>* values : {&utilization, &tiles, &space}) {
+            output.write(std::string(reinterpret_cast<const char*>(values->data()), values->size() * sizeof(float)));
+        }
+        return output.close();
+    }
+};
+
+#endif
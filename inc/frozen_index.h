@@ -0,0 +1,181 @@
+#ifndef _FROZEN_INDEX_H
+#define _FROZEN_INDEX_H
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include "tile.h"
+#include "tile_pool.h"
+#include "tile_registry.h"
+
+
+// Read-only point-location index over a finished tile plane.
+//
+// Every distinct tile bottom starts a horizontal slab. Listing every tile
+// in every slab it crosses grows quadratically once blocks are tall, so
+// the slabs are the leaves of a segment tree instead: a tile is stored at
+// the O(log n) nodes that cover its y-range, and the tiles of one node are
+// disjoint in x and kept sorted by left edge. A query binary-searches the
+// slab bottoms, then walks from the slab's leaf to the root and searches
+// each node's left edges; exactly one node on that path holds the tile.
+//
+// Left edges, right edges and tile indices are separate flat arrays, so the
+// inner search only touches a contiguous run of coordinates.
+template <typename Coord>
+class FrozenIndex {
+private:
+    typedef BasicPoint<Coord> Point;
+    typedef BasicRect<Coord> Rect;
+
+    // Runs shorter than this are scanned linearly; the counting loop has
+    // no branches and the compiler vectorizes it.
+    static const uint32_t LINEAR_SCAN = 16;
+
+    std::vector<Coord> slab_bottoms;
+    uint32_t leaves;
+    int depth;
+    std::vector<uint32_t> node_offsets;
+    std::vector<Coord> lefts;
+    std::vector<Coord> rights;
+    std::vector<TileIndex> tiles;
+
+    // Number of values not above `value` in an ascending run.
+    static uint32_t countNotAbove(const Coord* values, uint32_t count, Coord value) {
+        if (count <= LINEAR_SCAN) {
+            uint32_t not_above = 0;
+            for (uint32_t i = 0; i < count; i++) {
+                not_above += values[i] <= value;
+            }
+            return not_above;
+        }
+        if (values[0] > value) {
+            return 0;
+        }
+        const Coord* base = values;
+        while (count > 1) {
+            uint32_t half = count / 2;
+            base = base[half] <= value ? base + half : base;
+            count -= half;
+        }
+        return base - values + 1;
+    }
+
+    // Calls visit(node) for the canonical nodes covering leaves [first, last)
+    template <typename Visit>
+    void forEachCover(uint32_t first, uint32_t last, Visit visit) {
+        for (first += leaves, last += leaves; first < last; first >>= 1, last >>= 1) {
+            if (first & 1) visit(first++);
+            if (last & 1) visit(--last);
+        }
+    }
+
+public:
+    FrozenIndex(): leaves(0), depth(0) {}
+
+    //================================================================
+    // Getters and Setters
+    //================================================================
+    bool empty() const {
+        return slab_bottoms.empty();
+    }
+
+    size_t bytes() const {
+        return slab_bottoms.capacity() * sizeof(Coord) + node_offsets.capacity() * sizeof(uint32_t)
+            + (lefts.capacity() + rights.capacity()) * sizeof(Coord) + tiles.capacity() * sizeof(TileIndex);
+    }
+
+    //================================================================
+    // Public Methods
+    //================================================================
+    void build(TilePool<Coord>& pool, const TileRegistry& registry) {
+        clear();
+
+        std::vector<TileIndex> by_left(registry.begin(), registry.end());
+        std::sort(by_left.begin(), by_left.end(), [&pool](TileIndex a, TileIndex b) {
+            return pool[a].getRect().bottom_left.x < pool[b].getRect().bottom_left.x;
+        });
+
+        std::vector<Coord> bottoms;
+        bottoms.reserve(by_left.size());
+        for (TileIndex tile : by_left) {
+            bottoms.push_back(pool[tile].getRect().bottom_left.y);
+        }
+        std::sort(bottoms.begin(), bottoms.end());
+        bottoms.erase(std::unique(bottoms.begin(), bottoms.end()), bottoms.end());
+
+        leaves = 1;
+        depth = 0;
+        while (leaves < bottoms.size()) {
+            leaves <<= 1;
+            depth++;
+        }
+
+        // Slab range of every tile
+        std::vector<uint32_t> first_slab(by_left.size());
+        std::vector<uint32_t> last_slab(by_left.size());
+        for (size_t i = 0; i < by_left.size(); i++) {
+            Rect rect = pool[by_left[i]].getRect();
+            first_slab[i] = std::lower_bound(bottoms.begin(), bottoms.end(), rect.bottom_left.y) - bottoms.begin();
+            last_slab[i] = std::lower_bound(bottoms.begin(), bottoms.end(), rect.top_right.y) - bottoms.begin();
+        }
+
+        // Count pass
+        std::vector<uint32_t> offsets(2 * leaves + 1, 0);
+        for (size_t i = 0; i < by_left.size(); i++) {
+            forEachCover(first_slab[i], last_slab[i], [&offsets](uint32_t node) {
+                offsets[node + 1]++;
+            });
+        }
+        for (size_t node = 0; node < 2 * leaves; node++) {
+            offsets[node + 1] += offsets[node];
+        }
+
+        // Fill pass; tiles arrive sorted by x, so every node ends up sorted
+        size_t entries = offsets.back();
+        lefts.resize(entries);
+        rights.resize(entries);
+        tiles.resize(entries);
+        std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < by_left.size(); i++) {
+            TileIndex tile = by_left[i];
+            Rect rect = pool[tile].getRect();
+            forEachCover(first_slab[i], last_slab[i], [&](uint32_t node) {
+                uint32_t slot = cursor[node]++;
+                lefts[slot] = rect.bottom_left.x;
+                rights[slot] = rect.top_right.x;
+                tiles[slot] = tile;
+            });
+        }
+
+        slab_bottoms.swap(bottoms);
+        node_offsets.swap(offsets);
+    }
+
+    void clear() {
+        leaves = 0;
+        depth = 0;
+        std::vector<Coord>().swap(slab_bottoms);
+        std::vector<uint32_t>().swap(node_offsets);
+        std::vector<Coord>().swap(lefts);
+        std::vector<Coord>().swap(rights);
+        std::vector<TileIndex>().swap(tiles);
+    }
+
+    // The point must lie inside the outline the index was built from.
+    TileIndex find(Point point) const {
+        uint32_t slab = countNotAbove(slab_bottoms.data(), slab_bottoms.size(), point.y) - 1;
+        uint32_t leaf = leaves + slab;
+        for (int shift = depth; shift >= 0; shift--) {
+            uint32_t node = leaf >> shift;
+            uint32_t first = node_offsets[node];
+            uint32_t count = node_offsets[node + 1] - first;
+            uint32_t not_above = countNotAbove(lefts.data() + first, count, point.x);
+            if (not_above > 0 && point.x < rights[first + not_above - 1]) {
+                return tiles[first + not_above - 1];
+            }
+        }
+        return NIL_TILE;
+    }
+};
+
+#endif
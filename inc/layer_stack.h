@@ -0,0 +1,217 @@
+#ifndef _LAYER_STACK_H
+#define _LAYER_STACK_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include "outline.h"
+#include "parallel.h"
+#include "command_reader.h"
+
+
+// One output line per query: the bottom-left corner of the tile found by
+// P, or the solid and space tile counts of an A window. An X query fills
+// one answer per layer and prints them on one line.
+struct QueryAnswer
+{
+    long long first;
+    long long second;
+};
+
+// A command routed to one layer. Queries carry the answer slot they fill,
+// so the layers can run in any order and the answers still come out in
+// input order.
+struct LayerCommand
+{
+    Command command;
+    size_t slot;
+    size_t line;
+};
+
+// Stack of independent planes of the same outline, one per layer, filled
+// from a single pass over the input. Commands are queued per layer while
+// parsing and every layer then replays its queue on a thread of its own.
+// Each layer keeps its own tile pool: the pools are not synchronised, and
+// a layer thread never touches another layer's tiles.
+template <typename Coord>
+class LayerStack {
+public:
+    typedef BasicOutline<Coord> Outline;
+
+private:
+    Coord width;
+    Coord height;
+    std::map<int, std::unique_ptr<Outline>> layers;
+    std::map<int, std::vector<LayerCommand>> queues;
+    std::vector<QueryAnswer> answers;
+    std::vector<size_t> line_slots;     // answers printed on each output line
+    size_t error_line;
+    std::string error_message;
+
+    size_t addLine(size_t slots) {
+        size_t first = answers.size();
+        answers.resize(first + slots);
+        line_slots.push_back(slots);
+        return first;
+    }
+
+    // Replays one layer's queue. Runs of blocks are buffered and placed
+    // together like main does, and the layer is frozen once only P
+    // queries remain in its queue or a query run is as long as the layer
+    // is large.
+    void runLayer(Outline& outline, const std::vector<LayerCommand>& queue, bool bulk, bool use_freeze, size_t& failed_line, std::string& failure) {
+        size_t query_tail = queue.size();
+        while (query_tail > 0 && queue[query_tail - 1].command.type == Command::POINT) {
+            query_tail--;
+        }
+
+        size_t query_run = 0;
+        std::vector<BasicBlockRect<Coord>> pending_blocks;
+        auto flushBlocks = [&]() {
+            if (pending_blocks.empty()) {
+                return;
+            }
+            if (bulk && pending_blocks.size() >= outline.block_ids.size()) {
+                outline.bulkLoad(pending_blocks);
+            } else {
+                outline.createBlocks(pending_blocks);
+            }
+            pending_blocks.clear();
+        };
+        for (size_t i = 0; i < queue.size(); i++) {
+            const Command& command = queue[i].command;
+            if (command.type != Command::BLOCK && !pending_blocks.empty()) {
+                flushBlocks();
+            }
+
+            if (command.type == Command::POINT) {
+                query_run++;
+                if (use_freeze && !outline.isFrozen() && (i >= query_tail || query_run >= outline.blocks.size())) {
+                    outline.freeze();
+                }
+                TileIndex tile = outline.findTileatPoint(outline.narrow(command.point));
+                BasicPoint<Coord> corner = outline.getTile(tile).getRect().bottom_left;
+                answers[queue[i].slot] = {corner.x, corner.y};
+            } else
+            if (command.type == Command::AREA) {
+                QueryAnswer counts = {0, 0};
+                outline.enumerateArea(outline.narrow(command.rect), [&](TileIndex tile) {
+                    if (outline.getTile(tile).isTile()) {
+                        counts.first++;
+                    } else {
+                        counts.second++;
+                    }
+                });
+                answers[queue[i].slot] = counts;
+            } else
+            if (command.type == Command::DELETE) {
+                query_run = 0;
+                if (!outline.deleteBlock(command.id)) {
+                    failed_line = queue[i].line;
+                    failure = "line " + std::to_string(queue[i].line) + ": no block with id " + std::to_string(command.id);
+                    return;
+                }
+            } else {
+                query_run = 0;
+                pending_blocks.push_back({outline.narrow(command.rect), command.id});
+            }
+        }
+        flushBlocks();
+    }
+
+public:
+    //================================================================
+    // Constructors and Destructors
+    //================================================================
+    LayerStack(Coord width, Coord height): width(width), height(height), error_line(0) {}
+    LayerStack(const LayerStack&) = delete;
+    LayerStack& operator=(const LayerStack&) = delete;
+
+    //================================================================
+    // Getters and Setters
+    //================================================================
+    // The plane of `layer`, created empty on first use
+    Outline& getLayer(int layer) {
+        std::unique_ptr<Outline>& outline = layers[layer];
+        if (!outline) {
+            outline.reset(new Outline(width, height));
+        }
+        return *outline;
+    }
+
+    const std::map<int, std::unique_ptr<Outline>>& getLayers() const {
+        return layers;
+    }
+
+    const std::vector<QueryAnswer>& getAnswers() const {
+        return answers;
+    }
+
+    const std::vector<size_t>& getLineSlots() const {
+        return line_slots;
+    }
+
+    const std::string& error() const {
+        return error_message;
+    }
+
+    //================================================================
+    // Public Methods
+    //================================================================
+    // Queues a block, delete, P or A command for `layer`.
+    void add(int layer, const Command& command, size_t line) {
+        getLayer(layer);
+        size_t slot = 0;
+        if (command.type == Command::POINT || command.type == Command::AREA) {
+            slot = addLine(1);
+        }
+        queues[layer].push_back({command, slot, line});
+    }
+
+    // Queues an X query: a P query on every layer that exists so far,
+    // answered on one output line in layer order. Before the first layer
+    // the line has no slots and is written empty.
+    void addCrossQuery(BasicPoint<long long> point, size_t line) {
+        size_t slot = addLine(layers.size());
+        Command command;
+        command.type = Command::POINT;
+        command.point = point;
+        for (const std::pair<const int, std::unique_ptr<Outline>>& layer : layers) {
+            queues[layer.first].push_back({command, slot++, line});
+        }
+    }
+
+    // Replays every layer's queue, the longest queues first, on up to
+    // `threads` threads. On failure error() names the earliest bad line.
+    bool run(unsigned threads, bool bulk, bool use_freeze) {
+        std::vector<std::pair<Outline*, const std::vector<LayerCommand>*>> work;
+        for (const std::pair<const int, std::vector<LayerCommand>>& queue : queues) {
+            work.push_back({layers[queue.first].get(), &queue.second});
+        }
+        std::sort(work.begin(), work.end(), [](const std::pair<Outline*, const std::vector<LayerCommand>*>& a,
+                                               const std::pair<Outline*, const std::vector<LayerCommand>*>& b) {
+            return a.second->size() > b.second->size();
+        });
+
+        std::vector<size_t> failed_lines(work.size(), 0);
+        std::vector<std::string> failures(work.size());
+        parallelFor(work.size(), 1, threads, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                runLayer(*work[i].first, *work[i].second, bulk, use_freeze, failed_lines[i], failures[i]);
+            }
+        });
+        queues.clear();
+
+        for (size_t i = 0; i < work.size(); i++) {
+            if (!failures[i].empty() && (error_message.empty() || failed_lines[i] < error_line)) {
+                error_line = failed_lines[i];
+                error_message = failures[i];
+            }
+        }
+        return error_message.empty();
+    }
+};
+
+#endif
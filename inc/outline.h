@@ -4,19 +4,45 @@
 #include <tuple>
 #include <list>
 #include <string>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <queue>
+#include <functional>
 #include "tile.h"
+#include "tile_pool.h"
+#include "tile_registry.h"
+#include "frozen_index.h"
+#include "snapshot.h"
+#include "output_writer.h"
+#include "stats.h"
+#include "parallel.h"
+#include "density_map.h"
 
 
 struct HSplit
 {
-    Tile* upper;
-    Tile* lower;
+    TileIndex upper;
+    TileIndex lower;
 };
 
 struct VSplit
 {
-    Tile* left;
-    Tile* right;
+    TileIndex left;
+    TileIndex right;
+};
+
+// Tiles left when a block has been cut out of its space rows: the block
+// and the last remainders cut off left and right of it
+struct Carve
+{
+    TileIndex block;
+    TileIndex left;
+    TileIndex right;
 };
 
 struct NeighborCount
@@ -25,277 +51,1120 @@ struct NeighborCount
     int space_count;
 };
 
-class Outline {
+// Sides of a tile, in the order forEachNeighbor walks them
+enum Side { ABOVE, RIGHT, BELOW, LEFT };
+
+// Nearest solid tile on one side of a point or block, and the free
+// distance to it. The tile is NIL_TILE when nothing solid lies between
+// the source and the outline edge; the distance then runs to the edge.
+struct Obstacle
+{
+    TileIndex tile;
+    long long distance;
+};
+
+template <typename Coord>
+struct BasicBlockRect
+{
+    BasicRect<Coord> rect;
+    int id;
+};
+
+struct WalkStats
+{
+    unsigned long long lookups;
+    unsigned long long steps;
+};
+
+// Corner-stitched plane with coordinates of type Coord. The three widths
+// main dispatches to are instantiated once in src/outline.cpp.
+template <typename Coord>
+class BasicOutline {
+public:
+    typedef BasicPoint<Coord> Point;
+    typedef BasicRect<Coord> Rect;
+    typedef BasicTile<Coord> Tile;
+    typedef BasicBlockRect<Coord> BlockRect;
+
 private:
-    int width;
-    int height;
+    Coord width;
+    Coord height;
+    TilePool<Coord> pool;
+
+    // Point location: lookups start from the last tile found or from the
+    // entry tile of a coarse grid cell, whichever is closer to the point.
+    // Entries may go stale when tiles are merged away; a stale entry is
+    // never wrong, only a worse starting point, as long as it is live.
+    static const int ENTRY_GRID_SIZE = 64;
+    bool locator_enabled;
+    TileIndex hint;
+    std::vector<TileIndex> entry_grid;
+    Coord grid_cell_width;
+    Coord grid_cell_height;
+    WalkStats walk_stats;
+    OutlineStats stats;
+
+    // Built by freeze() for the query phase and dropped by the next edit
+    FrozenIndex<Coord> frozen;
+
+    // Optional neighbor counts of every solid tile, indexed by TileIndex
+    // and kept current by the split, merge and id-change primitives.
+    bool tracking_neighbors;
+    std::vector<NeighborCount> neighbor_counts;
+
+    int gridCell(Point point) {
+        return int(point.y / grid_cell_height) * ENTRY_GRID_SIZE + int(point.x / grid_cell_width);
+    }
+
+    void setEntry(TileIndex tile) {
+        entry_grid[gridCell(pool[tile].getRect().bottom_left)] = tile;
+    }
+
+    long long distanceTo(TileIndex tile, Point point) {
+        Rect rect = pool[tile].getRect();
+        long long dx = 0;
+        long long dy = 0;
+        if (point.x < rect.bottom_left.x) {
+            dx = rect.bottom_left.x - point.x;
+        } else if (point.x >= rect.top_right.x) {
+            dx = point.x - rect.top_right.x + 1;
+        }
+        if (point.y < rect.bottom_left.y) {
+            dy = rect.bottom_left.y - point.y;
+        } else if (point.y >= rect.top_right.y) {
+            dy = point.y - rect.top_right.y + 1;
+        }
+        return dx + dy;
+    }
+
+    TileIndex entryTile(Point point) {
+        TileIndex entry = entry_grid[gridCell(point)];
+        if (entry >= pool.slotCount() || pool[entry].isFree()) {
+            entry = start;
+        }
+        if (hint != NIL_TILE && !pool[hint].isFree() && distanceTo(hint, point) < distanceTo(entry, point)) {
+            return hint;
+        }
+        return entry;
+    }
+
+    // Position of (x, y) along the Hilbert curve filling the square of
+    // side 2^order (order <= 16). The quadrant at each level is read off
+    // the coordinates as turned so far; a turn swaps the axes and, in the
+    // last quadrant, mirrors both.
+    static uint64_t hilbertIndex(uint32_t x, uint32_t y, int order) {
+        uint64_t index = 0;
+        uint32_t swap = 0;
+        uint32_t mirror = 0;
+        for (int level = order - 1; level >= 0; level--) {
+            uint32_t bit_x = ((x >> level) & 1) ^ mirror;
+            uint32_t bit_y = ((y >> level) & 1) ^ mirror;
+            uint32_t rx = swap ? bit_y : bit_x;
+            uint32_t ry = swap ? bit_x : bit_y;
+            index = index << 2 | ((3 * rx) ^ ry);
+            uint32_t turn = ry ^ 1;
+            mirror ^= turn & rx;
+            swap ^= turn;
+        }
+        return index;
+    }
+
+    // Makes `tile` the hint for a lookup of `point` if it is closer to it
+    // than the last tile found
+    void offerHint(TileIndex tile, Point point) {
+        if (tile != NIL_TILE && (hint == NIL_TILE || pool[hint].isFree() || distanceTo(tile, point) < distanceTo(hint, point))) {
+            hint = tile;
+        }
+    }
+
+    // Sizes the entry grid for the current outline
+    void initLocator() {
+        hint = start;
+        entry_grid.assign(ENTRY_GRID_SIZE * ENTRY_GRID_SIZE, start);
+        grid_cell_width = (width + ENTRY_GRID_SIZE - 1) / ENTRY_GRID_SIZE;
+        grid_cell_height = (height + ENTRY_GRID_SIZE - 1) / ENTRY_GRID_SIZE;
+        if (grid_cell_width == 0) grid_cell_width = 1;
+        if (grid_cell_height == 0) grid_cell_height = 1;
+    }
+
+    // Points every locator entry and the hint back at `start`, then lets
+    // each live tile claim the cell its corner falls in.
+    void resetLocator() {
+        hint = start;
+        entry_grid.assign(entry_grid.size(), start);
+        for (TileIndex tile : blocks) {
+            setEntry(tile);
+        }
+    }
+    // Sets the above stitches of `lower`, the tiles whose top edges lie on
+    // one horizontal line, and the below stitches of `upper`, the tiles
+    // whose bottom edges lie on it. Both rows are sorted by left edge and
+    // walked together.
+    void stitchAcross(std::vector<TileIndex>& lower, std::vector<TileIndex>& upper) {
+        auto leftOf = [this](TileIndex a, TileIndex b) {
+            return pool[a].getRect().bottom_left.x < pool[b].getRect().bottom_left.x;
+        };
+        std::sort(lower.begin(), lower.end(), leftOf);
+        std::sort(upper.begin(), upper.end(), leftOf);
+        size_t j = 0;
+        for (TileIndex tile : lower) {
+            Coord x = pool[tile].getRect().top_right.x - 1;
+            while (j < upper.size() && pool[upper[j]].getRect().top_right.x <= x) {
+                j++;
+            }
+            pool[tile].setAbove(j < upper.size() ? upper[j] : NIL_TILE);
+        }
+        j = 0;
+        for (TileIndex tile : upper) {
+            Coord x = pool[tile].getRect().bottom_left.x;
+            while (j < lower.size() && pool[lower[j]].getRect().top_right.x <= x) {
+                j++;
+            }
+            pool[tile].setBelow(j < lower.size() ? lower[j] : NIL_TILE);
+        }
+    }
+    //================================================================
+    // Neighbor count maintenance
+    //================================================================
+    // A split or merge only changes the counts of the tiles it touches
+    // and of the at most two neighbors straddling the cut: a tile above a
+    // horizontal cut now borders the upper half instead of the whole, but
+    // a tile beside the cut borders both halves. An id change between
+    // solid and space moves one count of every solid neighbor from one
+    // kind to the other.
+    void bumpNeighbor(TileIndex neighbor, bool space, int delta) {
+        if (neighbor != NIL_TILE && pool[neighbor].isTile()) {
+            NeighborCount& count = neighbor_counts[neighbor];
+            (space ? count.space_count : count.solid_count) += delta;
+        }
+    }
+
+    // Called once `upper` has been cut off the top of `lower` at y
+    void trackHorizontalSplit(TileIndex upper, TileIndex lower, Coord y) {
+        if (neighbor_counts.size() < pool.slotCount()) {
+            neighbor_counts.resize(pool.slotCount());
+        }
+        bool space = pool[lower].isSpace();
+        TileIndex left = pool[upper].getLeft();
+        if (left != NIL_TILE && pool[left].getRect().bottom_left.y < y) {
+            bumpNeighbor(left, space, 1);
+        }
+        TileIndex right = pool[lower].getRight();
+        if (right != NIL_TILE && pool[right].getRect().top_right.y > y) {
+            bumpNeighbor(right, space, 1);
+        }
+        if (!space) {
+            neighbor_counts[upper] = neighborFinding(upper);
+            neighbor_counts[lower] = neighborFinding(lower);
+        }
+    }
+
+    // Called once `right` has been cut off the right of `left` at x
+    void trackVerticalSplit(TileIndex left, TileIndex right, Coord x) {
+        if (neighbor_counts.size() < pool.slotCount()) {
+            neighbor_counts.resize(pool.slotCount());
+        }
+        bool space = pool[left].isSpace();
+        TileIndex above = pool[left].getAbove();
+        if (above != NIL_TILE && pool[above].getRect().top_right.x > x) {
+            bumpNeighbor(above, space, 1);
+        }
+        TileIndex below = pool[right].getBelow();
+        if (below != NIL_TILE && pool[below].getRect().bottom_left.x < x) {
+            bumpNeighbor(below, space, 1);
+        }
+        if (!space) {
+            neighbor_counts[left] = neighborFinding(left);
+            neighbor_counts[right] = neighborFinding(right);
+        }
+    }
+
+    // Adds the counts of `from` to `into` when two solid halves merge:
+    // each stops counting the other, and a straddling neighbor that both
+    // counted is counted once.
+    void combineCounts(TileIndex into, TileIndex from, TileIndex straddler_a, TileIndex straddler_b) {
+        NeighborCount& count = neighbor_counts[into];
+        count.solid_count += neighbor_counts[from].solid_count - 2;
+        count.space_count += neighbor_counts[from].space_count;
+        for (TileIndex straddler : {straddler_a, straddler_b}) {
+            if (straddler != NIL_TILE) {
+                (pool[straddler].isSpace() ? count.space_count : count.solid_count)--;
+            }
+        }
+    }
+
+    // Called before `upper` is merged into `lower`
+    void trackVerticalMerge(TileIndex upper, TileIndex lower) {
+        Coord y = pool[lower].getRect().top_right.y;
+        bool space = pool[upper].isSpace();
+        TileIndex left = pool[upper].getLeft();
+        if (left != NIL_TILE && pool[left].getRect().bottom_left.y >= y) {
+            left = NIL_TILE;
+        }
+        TileIndex right = pool[lower].getRight();
+        if (right != NIL_TILE && pool[right].getRect().top_right.y <= y) {
+            right = NIL_TILE;
+        }
+        bumpNeighbor(left, space, -1);
+        bumpNeighbor(right, space, -1);
+        if (!space) {
+            combineCounts(lower, upper, left, right);
+        }
+    }
+
+    // Called before `right` is merged into `left`
+    void trackHorizontalMerge(TileIndex left, TileIndex right) {
+        Coord x = pool[left].getRect().top_right.x;
+        bool space = pool[right].isSpace();
+        TileIndex above = pool[left].getAbove();
+        if (above != NIL_TILE && pool[above].getRect().top_right.x <= x) {
+            above = NIL_TILE;
+        }
+        TileIndex below = pool[right].getBelow();
+        if (below != NIL_TILE && pool[below].getRect().bottom_left.x >= x) {
+            below = NIL_TILE;
+        }
+        bumpNeighbor(above, space, -1);
+        bumpNeighbor(below, space, -1);
+        if (!space) {
+            combineCounts(left, right, above, below);
+        }
+    }
+
+    // Changes the id of a tile, moving its neighbors' counts along when
+    // it turns from space into solid or back.
+    void setTileId(TileIndex tile, int id) {
+        bool was_space = pool[tile].isSpace();
+        pool[tile].setId(id);
+        if (!tracking_neighbors || was_space == pool[tile].isSpace()) {
+            return;
+        }
+        forEachNeighbor(tile, [&](TileIndex neighbor) {
+            bumpNeighbor(neighbor, was_space, -1);
+            bumpNeighbor(neighbor, !was_space, 1);
+        });
+        if (was_space) {
+            neighbor_counts[tile] = neighborFinding(tile);
+        }
+    }
+
+    void recountNeighbors() {
+        neighbor_counts.assign(pool.slotCount(), {0, 0});
+        for (TileIndex tile : blocks) {
+            if (pool[tile].isTile()) {
+                neighbor_counts[tile] = neighborFinding(tile);
+            }
+        }
+    }
+
+    // Read-only version sharing the tile pages of `plane` (see version())
+    BasicOutline(BasicOutline& plane, TilePool<Coord>&& shared)
+        : width(plane.width), height(plane.height), pool(std::move(shared)),
+          locator_enabled(plane.locator_enabled), hint(plane.hint), entry_grid(plane.entry_grid),
+          grid_cell_width(plane.grid_cell_width), grid_cell_height(plane.grid_cell_height),
+          tracking_neighbors(false), start(plane.start) {
+        walk_stats = {0, 0};
+    }
 public:
-    Tile* start;
-    std::list<Tile*> blocks;
+    TileIndex start;
+    TileRegistry blocks;
+    std::map<int, TileIndex> block_ids;
 
     //================================================================
     // Constructors and Destructors
     //================================================================
-    Outline(int width, int height): width(width), height(height) {
-        start = new Tile(
+    BasicOutline(Coord width, Coord height): width(width), height(height) {
+        start = pool.allocate(
             {
                 {width, height},// topRight
                 {0, 0},         // bottomLeft
             }, -1               // id
         );
 
-        blocks.push_back(start);
+        blocks.insert(start);
+
+        locator_enabled = true;
+        tracking_neighbors = false;
+        initLocator();
+        walk_stats = {0, 0};
+        STATS(stats.notePeak(pool.size());)
     }
-    ~Outline() {
-        for (Tile* block : blocks) {
-            delete block;
-        }
+    ~BasicOutline() {
+        // Tiles are owned by the pool
     }
 
     //================================================================
     // Getters and Setters
     //================================================================
-    int getWidth() {
+    Coord getWidth() {
         return width;
     }
 
-    int getHeight() {
+    Coord getHeight() {
         return height;
     }
 
+    Tile& getTile(TileIndex index) {
+        return pool[index];
+    }
+
+    MemoryUsage memoryUsage() {
+        return {
+            pool.size(),
+            pool.capacity(),
+            sizeof(Tile),
+            pool.bytes(),
+            // std::map node: three links and a color plus the payload
+            blocks.bytes() + block_ids.size() * (4 * sizeof(void*) + sizeof(std::pair<int, TileIndex>))
+                + frozen.bytes()
+        };
+    }
+
+    WalkStats getWalkStats() {
+        return walk_stats;
+    }
+
+    // Starts or stops maintaining neighbor counts; starting counts every
+    // solid tile once.
+    void setNeighborTracking(bool enabled) {
+        tracking_neighbors = enabled;
+        if (enabled) {
+            recountNeighbors();
+        } else {
+            std::vector<NeighborCount>().swap(neighbor_counts);
+        }
+    }
+
+    bool isTrackingNeighbors() {
+        return tracking_neighbors;
+    }
+
+    // Neighbor counts of a solid tile: the maintained ones when tracking,
+    // otherwise a walk around the tile.
+    NeighborCount neighborCount(TileIndex tile) {
+        if (tracking_neighbors && tile != NIL_TILE) {
+            return neighbor_counts[tile];
+        }
+        return neighborFinding(tile);
+    }
+
+    // Hot-path counters; all zero unless built with LAB1_STATS
+    const OutlineStats& getStats() {
+        return stats;
+    }
+
+    void setLocatorEnabled(bool enabled) {
+        locator_enabled = enabled;
+    }
+
+    Rect clip(Rect rect) {
+        return {
+            {std::min(rect.top_right.x, width), std::min(rect.top_right.y, height)},
+            {std::max(rect.bottom_left.x, Coord(0)), std::max(rect.bottom_left.y, Coord(0))}
+        };
+    }
+
+    // Narrow parsed 64-bit coordinates to Coord. Values beyond the outline
+    // are clamped to just outside it, where every query and bounds check
+    // treats them as before; main picks a Coord that can hold width + 1.
+    Coord narrow(long long value, Coord limit) {
+        return Coord(std::max(-1LL, std::min(value, (long long)limit + 1)));
+    }
+
+    Point narrow(BasicPoint<long long> point) {
+        return {narrow(point.x, width), narrow(point.y, height)};
+    }
+
+    Rect narrow(BasicRect<long long> rect) {
+        return {narrow(rect.top_right), narrow(rect.bottom_left)};
+    }
+
+    TileIndex findBlock(int id) {
+        std::map<int, TileIndex>::iterator it = block_ids.find(id);
+        return it == block_ids.end() ? NIL_TILE : it->second;
+    }
+
+    bool isFrozen() {
+        return !frozen.empty();
+    }
+
     //================================================================
     // Public Methods
     //================================================================
-    Tile* findTileatPoint(Tile* start, Point point) {
+    // Immutable version of the plane as it is now, for queries on another
+    // thread while this plane keeps being edited. The version shares all
+    // tile pages with the plane, which copies a page before writing to it
+    // while a version still holds it, so a version only costs a copy of
+    // the page table and the locator grid. It answers point, area,
+    // obstacle and neighbor queries by tile, but has no block table and
+    // must not be edited. Lookups move its locator hint, so each reader
+    // thread needs a version of its own.
+    std::unique_ptr<BasicOutline> version() {
+        return std::unique_ptr<BasicOutline>(new BasicOutline(*this, pool.share()));
+    }
+
+    // Stops sharing pages with the versions still alive; needed before
+    // the plane itself is read from several threads at once.
+    void unshare() {
+        pool.unshare();
+    }
+
+    // A run of stitch-walking queries pays for a compact() once it is
+    // about this many times shorter than the plane has tiles
+    static const size_t COMPACT_RUN_DIVISOR = 8;
+
+    // Moves every live tile into a fresh pool in Hilbert order of its
+    // bottom-left corner and rewrites all stitches and tile references.
+    // Splits and merges scatter neighboring tiles across the pool over
+    // time; afterwards a stitch walk mostly steps to a tile close by in
+    // memory, and so does a pass over the registry, which then lists the
+    // tiles in pool order. Corners are ranked on a grid of at most 2^16
+    // cells a side; tiles sharing a cell keep their relative order.
+    void compact() {
+        bool was_frozen = isFrozen();
+        thaw();
+
+        int order = 1;
+        while (order < 64 && (uint64_t(std::max(width, height)) >> order) != 0) {
+            order++;
+        }
+        int shift = std::max(0, order - 16);
+
+        // Hilbert index above the tile index, gathered in pool order
+        std::vector<uint8_t> live(pool.slotCount(), 0);
+        for (TileIndex tile : blocks) {
+            live[tile] = 1;
+        }
+        std::vector<uint64_t> keyed;
+        keyed.reserve(blocks.size());
+        for (TileIndex tile = 0; tile < pool.slotCount(); tile++) {
+            if (live[tile]) {
+                Point corner = pool[tile].getRect().bottom_left;
+                keyed.push_back(hilbertIndex(uint32_t(uint64_t(corner.x) >> shift), uint32_t(uint64_t(corner.y) >> shift), order - shift) << 32 | tile);
+            }
+        }
+        std::sort(keyed.begin(), keyed.end());
+
+        std::vector<TileIndex> remap(pool.slotCount(), NIL_TILE);
+        for (size_t i = 0; i < keyed.size(); i++) {
+            remap[TileIndex(keyed[i])] = TileIndex(i);
+        }
+        auto moved = [&remap](TileIndex tile) {
+            return tile == NIL_TILE ? NIL_TILE : remap[tile];
+        };
+
+        TilePool<Coord> packed;
+        packed.allocateRange(keyed.size());
+        TileRegistry registry;
+        for (size_t i = 0; i < keyed.size(); i++) {
+            Tile& tile = packed[TileIndex(i)];
+            tile = pool[TileIndex(keyed[i])];
+            tile.setAbove(moved(tile.getAbove()));
+            tile.setRight(moved(tile.getRight()));
+            tile.setBelow(moved(tile.getBelow()));
+            tile.setLeft(moved(tile.getLeft()));
+            registry.insert(TileIndex(i));
+        }
+        if (tracking_neighbors) {
+            std::vector<NeighborCount> counts(keyed.size());
+            for (size_t i = 0; i < keyed.size(); i++) {
+                counts[i] = neighbor_counts[TileIndex(keyed[i])];
+            }
+            neighbor_counts.swap(counts);
+        }
+
+        pool = std::move(packed);
+        blocks = std::move(registry);
+        for (std::pair<const int, TileIndex>& block : block_ids) {
+            block.second = remap[block.second];
+        }
+        start = remap[start];
+        hint = hint < remap.size() && remap[hint] != NIL_TILE ? remap[hint] : start;
+        for (TileIndex& entry : entry_grid) {
+            entry = entry < remap.size() && remap[entry] != NIL_TILE ? remap[entry] : start;
+        }
+        STATS(stats.notePeak(pool.size());)
+
+        if (was_frozen) {
+            freeze();
+        }
+    }
+
+    // Build the read-only slab index used by findTileatPoint(Point) until
+    // the next createBlock.
+    void freeze() {
+        frozen.build(pool, blocks);
+    }
+    void thaw() {
+        frozen.clear();
+    }
+    TileIndex findTileatPoint(TileIndex start, Point point) {
         // Protection
-        if (start == nullptr) {
-            return nullptr;
+        if (start == NIL_TILE) {
+            return NIL_TILE;
         }
         if (point.x < 0 || point.x >= width || point.y < 0 || point.y >= height) {
-            return nullptr;
+            return NIL_TILE;
         }
 
-        Tile* tile = start;
+        TileIndex tile = start;
+        Rect rect = pool[tile].getRect();
+        walk_stats.lookups++;
+        STATS(unsigned long long steps_before = walk_stats.steps;)
         while (
-            point.y < tile->getRect().bottom_left.y || point.y >= tile->getRect().top_right.y ||
-            point.x < tile->getRect().bottom_left.x || point.x >= tile->getRect().top_right.x
+            point.y < rect.bottom_left.y || point.y >= rect.top_right.y ||
+            point.x < rect.bottom_left.x || point.x >= rect.top_right.x
         ) {
             // 1) First move up or down, using right top (rt) and left bottom
             // (lb) stitches, until a tile is found whose vertical range contains
             // the desired point.
-            while (point.y < tile->getRect().bottom_left.y || point.y >= tile->getRect().top_right.y) {
-                if (point.y < tile->getRect().bottom_left.y) {
-                    tile = tile->getBelow();
+            while (point.y < rect.bottom_left.y || point.y >= rect.top_right.y) {
+                if (point.y < rect.bottom_left.y) {
+                    tile = pool[tile].getBelow();
                 } else {
-                    tile = tile->getAbove();
+                    tile = pool[tile].getAbove();
                 }
+                rect = pool[tile].getRect();
+                walk_stats.steps++;
             }
             // 2) Then move left or right, using tr and lb stitches, until a
             // tile is found whose horizontal range contains the desired point.
-            while (point.x < tile->getRect().bottom_left.x || point.x >= tile->getRect().top_right.x) {
-                if (point.x < tile->getRect().bottom_left.x) {
-                    tile = tile->getLeft();
+            while (point.x < rect.bottom_left.x || point.x >= rect.top_right.x) {
+                if (point.x < rect.bottom_left.x) {
+                    tile = pool[tile].getLeft();
                 } else {
-                    tile = tile->getRight();
+                    tile = pool[tile].getRight();
                 }
+                rect = pool[tile].getRect();
+                walk_stats.steps++;
             }
             // 3) Since the horizontal motion may have introduced a ver-
             // tical misalignment, steps l) and 2) may have to be iterated
             // several times to locate the tile containing the point. The con-
             // vexity of the tiles guarantees that the algorithm will converge.
         }
+        STATS(stats.walk_steps.add(walk_stats.steps - steps_before);)
+
+        return tile;
+    }
+    TileIndex findTileatPoint(Point point) {
+        if (point.x < 0 || point.x >= width || point.y < 0 || point.y >= height) {
+            return NIL_TILE;
+        }
+        if (!frozen.empty()) {
+            return frozen.find(point);
+        }
+        if (!locator_enabled) {
+            return findTileatPoint(start, point);
+        }
 
+        TileIndex tile = findTileatPoint(entryTile(point), point);
+        hint = tile;
+        entry_grid[gridCell(point)] = tile;
         return tile;
     }
-    HSplit splitTileHorizontally(Tile* tile, int y){
+    HSplit splitTileHorizontally(TileIndex tile, Coord y){
         // Protection
-        if (tile == nullptr) {
-            return {nullptr, nullptr};
+        if (tile == NIL_TILE) {
+            return {NIL_TILE, NIL_TILE};
         }
-        if (y <= tile->getRect().bottom_left.y || y >= tile->getRect().top_right.y) {
-            return {nullptr, nullptr};
+        if (y <= pool[tile].getRect().bottom_left.y || y >= pool[tile].getRect().top_right.y) {
+            return {NIL_TILE, NIL_TILE};
         }
 
         // Create new tiles
-        Tile* upper = new Tile(
+        TileIndex upper = pool.allocate(
             {
-                tile->getRect().top_right,           // topRight
-                {tile->getRect().bottom_left.x, y}   // bottomLeft
-            }, -1                                    // id
+                pool[tile].getRect().top_right,           // topRight
+                {pool[tile].getRect().bottom_left.x, y}   // bottomLeft
+            }, pool[tile].getId()                         // id
         );
-        Tile* lower = tile;
-        tile->setRect(
+        TileIndex lower = tile;
+        Tile& upper_tile = pool[upper];
+        Tile& lower_tile = pool[lower];
+        lower_tile.setRect(
             {
-                {tile->getRect().top_right.x, y},    // topRight
-                tile->getRect().bottom_left          // bottomLeft
+                {lower_tile.getRect().top_right.x, y},    // topRight
+                lower_tile.getRect().bottom_left          // bottomLeft
             }
         );
 
         // Update stitches
-        upper->setBelow(lower);
-        upper->setAbove(lower->getAbove());
-        upper->setRight(lower->getRight());
+        upper_tile.setBelow(lower);
+        upper_tile.setAbove(lower_tile.getAbove());
+        upper_tile.setRight(lower_tile.getRight());
 
-        Tile* tile_it;
+        TileIndex tile_it;
         // adjust corner stitches along top edge
-        for (tile_it = lower->getAbove(); tile_it != nullptr && tile_it->getBelow() == lower; tile_it = tile_it->getLeft()) {
-            tile_it->setBelow(upper);
+        for (tile_it = lower_tile.getAbove(); tile_it != NIL_TILE && pool[tile_it].getBelow() == lower; tile_it = pool[tile_it].getLeft()) {
+            pool[tile_it].setBelow(upper);
         }
-        lower->setAbove(upper);
+        lower_tile.setAbove(upper);
 
         // adjust corner stitches along right edge
-        for (tile_it = lower->getRight(); tile_it != nullptr && tile_it->getRect().bottom_left.y >= y; tile_it = tile_it->getBelow()) {
-            tile_it->setLeft(upper);
+        for (tile_it = lower_tile.getRight(); tile_it != NIL_TILE && pool[tile_it].getRect().bottom_left.y >= y; tile_it = pool[tile_it].getBelow()) {
+            pool[tile_it].setLeft(upper);
         }
-        lower->setRight(tile_it);
+        lower_tile.setRight(tile_it);
 
         // adjust corner stitches along left edge (lower)
-        for (tile_it = lower->getLeft(); tile_it != nullptr && tile_it->getRect().top_right.y <= y; tile_it = tile_it->getAbove()) {
-            // Nothing to do, because `Tile* lower = tile;`
+        for (tile_it = lower_tile.getLeft(); tile_it != NIL_TILE && pool[tile_it].getRect().top_right.y <= y; tile_it = pool[tile_it].getAbove()) {
+            // Nothing to do, because `lower = tile;`
         }
-        upper->setLeft(tile_it);
+        upper_tile.setLeft(tile_it);
 
         // adjust corner stitches along left edge (upper)
-        for (; tile_it != nullptr && tile_it->getRight() == lower; tile_it = tile_it->getAbove()) {
-            tile_it->setRight(upper);
+        for (; tile_it != NIL_TILE && pool[tile_it].getRight() == lower; tile_it = pool[tile_it].getAbove()) {
+            pool[tile_it].setRight(upper);
         }
 
         // Add the new tiles to the list
-        blocks.push_back(upper);
+        blocks.insert(upper);
+        setEntry(upper);
+        if (tracking_neighbors) {
+            trackHorizontalSplit(upper, lower, y);
+        }
+        STATS(stats.splits++; stats.allocations++; stats.notePeak(pool.size());)
 
         return {upper, lower};
     }
-    VSplit splitTileVertically(Tile* tile, int x) {
+    VSplit splitTileVertically(TileIndex tile, Coord x) {
         // Protection
-        if (tile == nullptr) {
-            return {nullptr, nullptr};
+        if (tile == NIL_TILE) {
+            return {NIL_TILE, NIL_TILE};
         }
-        if (x <= tile->getRect().bottom_left.x || x >= tile->getRect().top_right.x) {
-            return {nullptr, nullptr};
+        if (x <= pool[tile].getRect().bottom_left.x || x >= pool[tile].getRect().top_right.x) {
+            return {NIL_TILE, NIL_TILE};
         }
 
         // Create new tiles
-        Tile* right = new Tile(
+        TileIndex right = pool.allocate(
             {
-                tile->getRect().top_right,           // topRight
-                {x, tile->getRect().bottom_left.y}   // bottomLeft
-            }, -1                                    // id
+                pool[tile].getRect().top_right,           // topRight
+                {x, pool[tile].getRect().bottom_left.y}   // bottomLeft
+            }, pool[tile].getId()                         // id
         );
-        Tile* left = tile;
-        tile->setRect(
+        TileIndex left = tile;
+        Tile& right_tile = pool[right];
+        Tile& left_tile = pool[left];
+        left_tile.setRect(
             {
-                {x, tile->getRect().top_right.y},    // topRight
-                tile->getRect().bottom_left          // bottomLeft
+                {x, left_tile.getRect().top_right.y},     // topRight
+                left_tile.getRect().bottom_left           // bottomLeft
             }
         );
 
         // Update stitches
-        right->setLeft(left);
-        right->setRight(left->getRight());
-        right->setAbove(left->getAbove());
+        right_tile.setLeft(left);
+        right_tile.setRight(left_tile.getRight());
+        right_tile.setAbove(left_tile.getAbove());
 
-        Tile* tile_it;
+        TileIndex tile_it;
         // adjust corner stitches along right edge
-        for (tile_it = left->getRight(); tile_it != nullptr && tile_it->getLeft() == left; tile_it = tile_it->getBelow()) {
-            tile_it->setLeft(right);
+        for (tile_it = left_tile.getRight(); tile_it != NIL_TILE && pool[tile_it].getLeft() == left; tile_it = pool[tile_it].getBelow()) {
+            pool[tile_it].setLeft(right);
         }
-        left->setRight(right);
+        left_tile.setRight(right);
 
         // adjust corner stitches along top edge
-        for (tile_it = left->getAbove(); tile_it != nullptr && tile_it->getRect().bottom_left.x >= x; tile_it = tile_it->getLeft()) {
-            tile_it->setBelow(right);
+        for (tile_it = left_tile.getAbove(); tile_it != NIL_TILE && pool[tile_it].getRect().bottom_left.x >= x; tile_it = pool[tile_it].getLeft()) {
+            pool[tile_it].setBelow(right);
         }
-        left->setAbove(tile_it);
+        left_tile.setAbove(tile_it);
 
         // adjust corner stitches along bottom edge (left)
-        for (tile_it = left->getBelow(); tile_it != nullptr && tile_it->getRect().top_right.x <= x; tile_it = tile_it->getRight()) {
-            // Nothing to do, because `Tile* left = tile;`
+        for (tile_it = left_tile.getBelow(); tile_it != NIL_TILE && pool[tile_it].getRect().top_right.x <= x; tile_it = pool[tile_it].getRight()) {
+            // Nothing to do, because `left = tile;`
         }
-        right->setBelow(tile_it);
+        right_tile.setBelow(tile_it);
 
         // adjust corner stitches along bottom edge (right)
-        for (; tile_it != nullptr && tile_it->getAbove() == left; tile_it = tile_it->getRight()) {
-            tile_it->setAbove(right);
+        for (; tile_it != NIL_TILE && pool[tile_it].getAbove() == left; tile_it = pool[tile_it].getRight()) {
+            pool[tile_it].setAbove(right);
         }
 
         // Add the new tiles to the list
-        blocks.push_back(right);
+        blocks.insert(right);
+        setEntry(right);
+        if (tracking_neighbors) {
+            trackVerticalSplit(left, right, x);
+        }
+        STATS(stats.splits++; stats.allocations++; stats.notePeak(pool.size());)
 
         return {left, right};
     }
-    Tile* mergeDown(Tile* tile) {
+    TileIndex mergeDown(TileIndex tile) {
         // Protection
-        if (tile == nullptr) {
-            return nullptr;
+        if (tile == NIL_TILE) {
+            return NIL_TILE;
         }
-        Tile* lower = tile->getBelow();
-        if (lower == nullptr) {
+        TileIndex lower = pool[tile].getBelow();
+        if (lower == NIL_TILE) {
             return tile;
         }
+        Tile& upper_tile = pool[tile];
+        Tile& lower_tile = pool[lower];
 
         // Check if the two tiles are horizontally aligned
-        if (tile->getRect().bottom_left.x != lower->getRect().bottom_left.x || 
-            tile->getRect().top_right.x != lower->getRect().top_right.x) {
+        if (upper_tile.getRect().bottom_left.x != lower_tile.getRect().bottom_left.x || 
+            upper_tile.getRect().top_right.x != lower_tile.getRect().top_right.x) {
             return tile;
         }
 
         // Check the id of the two tiles
-        if (tile->getId() != lower->getId()) {
+        if (upper_tile.getId() != lower_tile.getId()) {
             return tile;
         }
+        if (tracking_neighbors) {
+            trackVerticalMerge(tile, lower);
+        }
 
         // Change the size of the tile
-        lower->setRect(
+        lower_tile.setRect(
             {
-                tile->getRect().top_right,           // topRight
-                lower->getRect().bottom_left         // bottomLeft
+                upper_tile.getRect().top_right,      // topRight
+                lower_tile.getRect().bottom_left     // bottomLeft
             }
         );
 
         // Update stitches
-        lower->setAbove(tile->getAbove());
-        lower->setRight(tile->getRight());
+        lower_tile.setAbove(upper_tile.getAbove());
+        lower_tile.setRight(upper_tile.getRight());
 
-        Tile* tile_it;
+        TileIndex tile_it;
         // adjust corner stitches along right edge
-        for (tile_it = tile->getRight(); tile_it != nullptr && tile_it->getLeft() == tile; tile_it = tile_it->getBelow()) {
-            tile_it->setLeft(lower);
+        for (tile_it = upper_tile.getRight(); tile_it != NIL_TILE && pool[tile_it].getLeft() == tile; tile_it = pool[tile_it].getBelow()) {
+            pool[tile_it].setLeft(lower);
         }
         
         // adjust corner stitches along left edge
-        for (tile_it = tile->getLeft(); tile_it != nullptr && tile_it->getRight() == tile; tile_it = tile_it->getAbove()) {
-            tile_it->setRight(lower);
+        for (tile_it = upper_tile.getLeft(); tile_it != NIL_TILE && pool[tile_it].getRight() == tile; tile_it = pool[tile_it].getAbove()) {
+            pool[tile_it].setRight(lower);
         }
 
         // adjust corner stitches along top edge
-        for (tile_it = tile->getAbove(); tile_it != nullptr && tile_it->getBelow() == tile; tile_it = tile_it->getLeft()) {
-            tile_it->setBelow(lower);
+        for (tile_it = upper_tile.getAbove(); tile_it != NIL_TILE && pool[tile_it].getBelow() == tile; tile_it = pool[tile_it].getLeft()) {
+            pool[tile_it].setBelow(lower);
         }
 
         // Free the tile
-        blocks.remove(tile);
-        delete tile;
+        blocks.erase(tile);
+        pool.release(tile);
+        STATS(stats.merges++; stats.releases++;)
+        setEntry(lower);
 
         return lower;
     }
-    Tile* mergeUp(Tile* tile) {
+    TileIndex mergeUp(TileIndex tile) {
         // Protection
-        if (tile == nullptr) {
-            return nullptr;
+        if (tile == NIL_TILE) {
+            return NIL_TILE;
         }
-        Tile* upper = tile->getAbove();
-        if (upper == nullptr) {
+        TileIndex upper = pool[tile].getAbove();
+        if (upper == NIL_TILE) {
             return tile;
         }
 
         // Use mergeDown
         return mergeDown(upper);
     }
-    Tile* createBlock(Rect rect, int id) {
+    TileIndex mergeLeft(TileIndex tile) {
+        // Protection
+        if (tile == NIL_TILE) {
+            return NIL_TILE;
+        }
+        TileIndex left = pool[tile].getLeft();
+        if (left == NIL_TILE) {
+            return tile;
+        }
+        Tile& right_tile = pool[tile];
+        Tile& left_tile = pool[left];
+
+        // Check if the two tiles are vertically aligned
+        if (right_tile.getRect().bottom_left.y != left_tile.getRect().bottom_left.y ||
+            right_tile.getRect().top_right.y != left_tile.getRect().top_right.y) {
+            return tile;
+        }
+
+        // Check the id of the two tiles
+        if (right_tile.getId() != left_tile.getId()) {
+            return tile;
+        }
+        if (tracking_neighbors) {
+            trackHorizontalMerge(left, tile);
+        }
+
+        // Change the size of the tile
+        left_tile.setRect(
+            {
+                right_tile.getRect().top_right,      // topRight
+                left_tile.getRect().bottom_left      // bottomLeft
+            }
+        );
+
+        // Update stitches
+        left_tile.setAbove(right_tile.getAbove());
+        left_tile.setRight(right_tile.getRight());
+
+        TileIndex tile_it;
+        // adjust corner stitches along right edge
+        for (tile_it = right_tile.getRight(); tile_it != NIL_TILE && pool[tile_it].getLeft() == tile; tile_it = pool[tile_it].getBelow()) {
+            pool[tile_it].setLeft(left);
+        }
+
+        // adjust corner stitches along top edge
+        for (tile_it = right_tile.getAbove(); tile_it != NIL_TILE && pool[tile_it].getBelow() == tile; tile_it = pool[tile_it].getLeft()) {
+            pool[tile_it].setBelow(left);
+        }
+
+        // adjust corner stitches along bottom edge
+        for (tile_it = right_tile.getBelow(); tile_it != NIL_TILE && pool[tile_it].getAbove() == tile; tile_it = pool[tile_it].getRight()) {
+            pool[tile_it].setAbove(left);
+        }
+
+        // Free the tile
+        blocks.erase(tile);
+        pool.release(tile);
+        STATS(stats.merges++; stats.releases++;)
+        setEntry(left);
+
+        return left;
+    }
+    // Moves the part of `tile` left of x into `below`, the tile spanning
+    // exactly that part right under it, which grows up over it; `tile`
+    // keeps the rest. Equivalent to splitting `tile` at x and merging the
+    // left half down, without allocating the half. Neighbor counts are
+    // not maintained.
+    void transferLeftStrip(TileIndex tile, Coord x, TileIndex below) {
+        Tile& strip_tile = pool[tile];
+        Tile& below_tile = pool[below];
+        Coord top = strip_tile.getRect().top_right.y;
+        TileIndex below_right = below_tile.getRight();
+
+        TileIndex tile_it;
+        // adjust corner stitches along top edge
+        for (tile_it = strip_tile.getAbove(); tile_it != NIL_TILE && pool[tile_it].getRect().bottom_left.x >= x; tile_it = pool[tile_it].getLeft()) {
+            // Nothing to do, these stay above `tile`
+        }
+        below_tile.setAbove(tile_it);
+        for (; tile_it != NIL_TILE && pool[tile_it].getBelow() == tile; tile_it = pool[tile_it].getLeft()) {
+            pool[tile_it].setBelow(below);
+        }
+
+        // adjust corner stitches along left edge
+        for (tile_it = strip_tile.getLeft(); tile_it != NIL_TILE && pool[tile_it].getRight() == tile; tile_it = pool[tile_it].getAbove()) {
+            pool[tile_it].setRight(below);
+        }
+
+        below_tile.setRight(tile);
+        strip_tile.setLeft(below);
+        strip_tile.setBelow(below_right);
+        below_tile.setRect({{x, top}, below_tile.getRect().bottom_left});
+        strip_tile.setRect({strip_tile.getRect().top_right, {x, strip_tile.getRect().bottom_left.y}});
+        setEntry(tile);
+        STATS(stats.transfers++;)
+    }
+    // Mirror of transferLeftStrip: the part of `tile` right of x grows
+    // `below` up, and `tile` keeps the part left of x.
+    void transferRightStrip(TileIndex tile, Coord x, TileIndex below) {
+        Tile& strip_tile = pool[tile];
+        Tile& below_tile = pool[below];
+        Coord top = strip_tile.getRect().top_right.y;
+
+        TileIndex tile_it;
+        // adjust corner stitches along right edge
+        for (tile_it = strip_tile.getRight(); tile_it != NIL_TILE && pool[tile_it].getLeft() == tile; tile_it = pool[tile_it].getBelow()) {
+            pool[tile_it].setLeft(below);
+        }
+        below_tile.setRight(strip_tile.getRight());
+
+        // adjust corner stitches along top edge
+        below_tile.setAbove(strip_tile.getAbove());
+        for (tile_it = strip_tile.getAbove(); tile_it != NIL_TILE && pool[tile_it].getRect().bottom_left.x >= x; tile_it = pool[tile_it].getLeft()) {
+            pool[tile_it].setBelow(below);
+        }
+        strip_tile.setAbove(tile_it);
+
+        strip_tile.setRight(below);
+        below_tile.setRect({{below_tile.getRect().top_right.x, top}, below_tile.getRect().bottom_left});
+        strip_tile.setRect({{x, top}, strip_tile.getRect().bottom_left});
+        STATS(stats.transfers++;)
+    }
+    // The tile that a piece [left, right) of a row extends upwards: the
+    // tile right under the piece, if it spans exactly the piece and has
+    // the same id, else NIL_TILE. `under` is a tile right under the row,
+    // at or left of the piece.
+    TileIndex extendedTile(TileIndex under, Coord left, Coord right, int id) {
+        while (under != NIL_TILE && pool[under].getRect().top_right.x <= left) {
+            under = pool[under].getRight();
+        }
+        if (under == NIL_TILE || pool[under].getRect().bottom_left.x != left || pool[under].getRect().top_right.x != right || pool[under].getId() != id) {
+            return NIL_TILE;
+        }
+        return under;
+    }
+    // Cuts the block [left, right) out of the space rows from `first` up
+    // to `top` with the split and merge primitives: each row is split in
+    // up to three, and each piece merged down where it lines up with the
+    // tile below it.
+    Carve splitRows(TileIndex first, Coord left, Coord right, Coord top, int id) {
+        Carve carve = {NIL_TILE, NIL_TILE, NIL_TILE};
+        TileIndex next_tile = NIL_TILE;
+        for (TileIndex tile = first; tile != NIL_TILE && pool[tile].getRect().top_right.y <= top; tile = next_tile) {
+            // next_tile = tile->getAbove();
+            next_tile = findTileatPoint(tile, {left, pool[tile].getRect().top_right.y});
+            TileIndex tt = tile;
+
+            // Split left
+            VSplit v_split_l = splitTileVertically(tt, left);
+            if (v_split_l.left != NIL_TILE) {
+                carve.left = mergeDown(v_split_l.left);
+                tt = v_split_l.right;
+            }
+
+            // Split right
+            VSplit v_split_r = splitTileVertically(tt, right);
+            if (v_split_r.right != NIL_TILE) {
+                carve.right = mergeDown(v_split_r.right);
+                tt = v_split_r.left;
+            }
+
+            // Set id of the tile
+            setTileId(tt, id);
+
+            // Merge down
+            carve.block = mergeDown(tt);
+        }
+        return carve;
+    }
+    // Same result as splitRows without the tiles a split allocates and
+    // the next merge releases again. Each row is cut into its left
+    // remainder, block piece and right remainder, and every piece that
+    // only extends the tile below it is moved into that tile. The row
+    // tile itself becomes the leftmost piece that starts a new tile, and
+    // only the new pieces right of it are split off, so only tiles that
+    // survive are allocated. A row whose pieces all extend tiles below
+    // it is released into the last one.
+    Carve transferRows(TileIndex first, Coord left, Coord right, Coord top, int id) {
+        Carve carve = {NIL_TILE, NIL_TILE, NIL_TILE};
+        TileIndex next_tile = NIL_TILE;
+        for (TileIndex tile = first; tile != NIL_TILE && pool[tile].getRect().top_right.y <= top; tile = next_tile) {
+            next_tile = findTileatPoint(tile, {left, pool[tile].getRect().top_right.y});
+            Rect row = pool[tile].getRect();
+            int space = pool[tile].getId();
+
+            // Pieces left to right, with the tiles they extend
+            Coord edges[4];
+            TileIndex extended[3];
+            int roles[3];               // 0 left remainder, 1 block, 2 right remainder
+            int pieces = 0;
+            TileIndex under = carve.block != NIL_TILE ? carve.block : pool[tile].getBelow();
+            if (row.bottom_left.x < left) {
+                edges[pieces] = row.bottom_left.x;
+                extended[pieces] = extendedTile(pool[tile].getBelow(), row.bottom_left.x, left, space);
+                roles[pieces++] = 0;
+            }
+            edges[pieces] = left;
+            extended[pieces] = carve.block != NIL_TILE ? carve.block : extendedTile(under, left, right, id);
+            roles[pieces++] = 1;
+            if (right < row.top_right.x) {
+                edges[pieces] = right;
+                extended[pieces] = extendedTile(carve.block != NIL_TILE ? pool[carve.block].getRight() : under, right, row.top_right.x, space);
+                roles[pieces++] = 2;
+            }
+            edges[pieces] = row.top_right.x;
+
+            int keep = 0;
+            while (keep < pieces - 1 && extended[keep] != NIL_TILE) {
+                keep++;
+            }
+            TileIndex holders[3];
+            for (int i = 0; i < keep; i++) {
+                transferLeftStrip(tile, edges[i + 1], extended[i]);
+                holders[i] = extended[i];
+            }
+            for (int i = pieces - 1; i > keep; i--) {
+                if (extended[i] != NIL_TILE) {
+                    transferRightStrip(tile, edges[i], extended[i]);
+                    holders[i] = extended[i];
+                } else {
+                    holders[i] = splitTileVertically(tile, edges[i]).right;
+                    if (roles[i] == 1) {
+                        setTileId(holders[i], id);
+                    }
+                }
+            }
+            holders[keep] = tile;
+            if (roles[keep] == 1) {
+                setTileId(tile, id);
+            }
+            if (extended[keep] != NIL_TILE) {
+                holders[keep] = mergeDown(tile);
+            }
+
+            for (int i = 0; i < pieces; i++) {
+                if (roles[i] == 0) {
+                    carve.left = holders[i];
+                } else
+                if (roles[i] == 1) {
+                    carve.block = holders[i];
+                } else {
+                    carve.right = holders[i];
+                }
+            }
+        }
+        return carve;
+    }
+    TileIndex createBlock(Rect rect, int id) {
+        thaw();
+        return placeBlock(rect, id, NIL_TILE, nullptr);
+    }
+    // Inserts a run of blocks with the same result as createBlock on each
+    // of them in turn. The run is placed in raster order, and the lookups
+    // for each block walk from the block placed before it. The merges of
+    // the left and right remainders with the tiles above them wait until
+    // the whole run is placed, since the next block in the row often
+    // splits those remainders again. Space tiles stay horizontally
+    // maximal in between, which is all placement relies on, and the
+    // deferred merges restore the unique maximal-strip plane.
+    //
+    // The previous block is offered to the locator as a hint, so a lookup
+    // walks from it unless the last tile found or a grid entry is closer:
+    // a walk from a distant tile along wide space strips can cost more
+    // than the lookups it saves.
+    void createBlocks(std::vector<BlockRect> new_blocks) {
+        if (new_blocks.empty()) {
+            return;
+        }
+        thaw();
+        std::sort(new_blocks.begin(), new_blocks.end(), [](const BlockRect& a, const BlockRect& b) {
+            return a.rect.bottom_left.y != b.rect.bottom_left.y ? a.rect.bottom_left.y < b.rect.bottom_left.y : a.rect.bottom_left.x < b.rect.bottom_left.x;
+        });
+        std::vector<std::pair<TileIndex, Point>> seams;
+        TileIndex previous = NIL_TILE;
+        for (const BlockRect& block : new_blocks) {
+            previous = placeBlock(block.rect, block.id, previous, &seams);
+        }
+        for (const std::pair<TileIndex, Point>& seam : seams) {
+            TileIndex tile = findTileatPoint(seam.first, seam.second);
+            if (pool[tile].getRect().top_right.y == seam.second.y + 1) {
+                mergeUp(tile);
+            }
+        }
+    }
+    // Places one block; both edge lookups may start from `previous`. With
+    // `seams` the remainders are not merged up; the point just below the
+    // top of each is added to `seams` instead, together with the new
+    // block, which stays put and is a short walk away.
+    TileIndex placeBlock(Rect rect, int id, TileIndex previous, std::vector<std::pair<TileIndex, Point>>* seams) {
+        STATS(unsigned long long splits_before = stats.splits; unsigned long long merges_before = stats.merges;)
+        STATS(unsigned long long allocations_before = stats.allocations; unsigned long long releases_before = stats.releases;)
+
         // 1) Find the space tile containing the top edge of the area
         // to be occupied by the new tile (because of the strip property,
         // a single space tile must contain the entire edge).
-        Tile* top_strip_tile = findTileatPoint(start, {rect.bottom_left.x, rect.top_right.y});
+        offerHint(previous, {rect.bottom_left.x, rect.top_right.y});
+        TileIndex top_strip_tile = findTileatPoint({rect.bottom_left.x, rect.top_right.y});
 
         // 2) Split the top space tile along a horizontal line into a piece
         // entirely above the new tile and a piece overlapping the new
@@ -305,7 +1174,8 @@ public:
         // 3) Find the space tile containing the bottom edge of the
         // new solid tile, split it in the same fashion, and update stitches
         // around it.
-        Tile* bottom_strip_tile = findTileatPoint(start, rect.bottom_left);
+        offerHint(previous, rect.bottom_left);
+        TileIndex bottom_strip_tile = findTileatPoint(rect.bottom_left);
         HSplit h_split_bottom = splitTileHorizontally(bottom_strip_tile, rect.bottom_left.y);
 
         // 4 ) Work down along the left side of the area of the new tile, 
@@ -316,96 +1186,961 @@ public:
         // and a piece entirely within the new tile. This splitting may
         // make it possible to merge the left and right remainders verti-
         // cally with the tiles just above them: merge whenever possible.
-        Tile* next_tile = nullptr;
-        Tile* ret_tile = nullptr;
-        Tile* t_left = nullptr;
-        Tile* t_right = nullptr;
-        for (
-            Tile* tile = h_split_bottom.upper == nullptr ? bottom_strip_tile : h_split_bottom.upper;
-            tile != nullptr && tile->getRect().top_right.y <= rect.top_right.y; //TODO: Check this condition
-            tile = next_tile
-        ) {
-            // next_tile = tile->getAbove();
-            next_tile = findTileatPoint(tile, {rect.bottom_left.x, tile->getRect().top_right.y});
-            Tile* tt = tile;
+        //
+        // Neighbor counts are kept by the split and merge primitives, so a
+        // plane that tracks them still splits and merges each row.
+        TileIndex first_row = h_split_bottom.upper == NIL_TILE ? bottom_strip_tile : h_split_bottom.upper;
+        Carve carve = tracking_neighbors
+            ? splitRows(first_row, rect.bottom_left.x, rect.top_right.x, rect.top_right.y, id)
+            : transferRows(first_row, rect.bottom_left.x, rect.top_right.x, rect.top_right.y, id);
+        TileIndex ret_tile = carve.block;
+        TileIndex t_left = carve.left;
+        TileIndex t_right = carve.right;
+        if (seams != nullptr) {
+            if (t_left != NIL_TILE) {
+                seams->push_back({ret_tile, {Coord(rect.bottom_left.x - 1), Coord(rect.top_right.y - 1)}});
+            }
+            if (t_right != NIL_TILE) {
+                seams->push_back({ret_tile, {rect.top_right.x, Coord(rect.top_right.y - 1)}});
+            }
+        } else {
+            if (t_left != NIL_TILE) {
+                mergeUp(t_left);
+            }
+            if (t_right != NIL_TILE) {
+                mergeUp(t_right);
+            }
+        }
+        block_ids[id] = ret_tile;
+        STATS(stats.create_splits.add(stats.splits - splits_before); stats.create_merges.add(stats.merges - merges_before);)
+        STATS(stats.create_allocations.add(stats.allocations - allocations_before); stats.create_releases.add(stats.releases - releases_before);)
 
-            // Split left
-            VSplit v_split_l = splitTileVertically(tt, rect.bottom_left.x);
-            if (v_split_l.left != nullptr) {
-                t_left = mergeDown(v_split_l.left);
-                tt = v_split_l.right;
+        return ret_tile;
+    }
+    bool deleteBlock(int id) {
+        TileIndex block = findBlock(id);
+        if (block == NIL_TILE) {
+            return false;
+        }
+        thaw();
+        block_ids.erase(id);
+        Rect rect = pool[block].getRect();
+
+        // 1) Turn the block back into space. The maximal-horizontal-strip
+        // invariant now only fails inside the band the block occupied and
+        // along its top and bottom edges.
+        setTileId(block, -1);
+
+        // 2) Collect the heights where a space tile on either side of the
+        // band begins or ends. The rows of the final space tiles inside
+        // the band can only change extent at these heights.
+        std::vector<Coord> cuts = {rect.bottom_left.y, rect.top_right.y};
+        TileIndex tile_it;
+        for (tile_it = pool[block].getLeft(); tile_it != NIL_TILE && pool[tile_it].getRect().bottom_left.y < rect.top_right.y; tile_it = pool[tile_it].getAbove()) {
+            if (pool[tile_it].isSpace()) {
+                cuts.push_back(std::max(pool[tile_it].getRect().bottom_left.y, rect.bottom_left.y));
+                cuts.push_back(std::min(pool[tile_it].getRect().top_right.y, rect.top_right.y));
             }
+        }
+        for (tile_it = pool[block].getRight(); tile_it != NIL_TILE && pool[tile_it].getRect().top_right.y > rect.bottom_left.y; tile_it = pool[tile_it].getBelow()) {
+            if (pool[tile_it].isSpace()) {
+                cuts.push_back(std::max(pool[tile_it].getRect().bottom_left.y, rect.bottom_left.y));
+                cuts.push_back(std::min(pool[tile_it].getRect().top_right.y, rect.top_right.y));
+            }
+        }
+        std::sort(cuts.begin(), cuts.end());
+        cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
 
-            // Split right
-            VSplit v_split_r = splitTileVertically(tt, rect.top_right.x);
-            if (v_split_r.right != nullptr) {
-                t_right = mergeDown(v_split_r.right);
-                tt = v_split_r.left;
+        // 3) Split the old block and the space tiles beside it at every
+        // cut, so each row of the band lines up with its side neighbors.
+        for (Coord y : cuts) {
+            if (rect.bottom_left.x > 0) {
+                TileIndex left = findTileatPoint(block, {Coord(rect.bottom_left.x - 1), y});
+                if (left != NIL_TILE && pool[left].isSpace()) {
+                    splitTileHorizontally(left, y);
+                }
             }
+            if (rect.top_right.x < width) {
+                TileIndex right = findTileatPoint(block, {rect.top_right.x, y});
+                if (right != NIL_TILE && pool[right].isSpace()) {
+                    splitTileHorizontally(right, y);
+                }
+            }
+        }
+        std::vector<TileIndex> rows;
+        for (size_t i = cuts.size() - 1; i > 0; i--) {
+            HSplit h_split = splitTileHorizontally(block, cuts[i - 1]);
+            rows.push_back(h_split.upper == NIL_TILE ? block : h_split.upper);
+        }
 
-            // Set id of the tile
-            tt->setId(id);
+        // 4) Merge every row with the space tiles to its left and right,
+        // then merge the widened rows vertically, bottom to top, including
+        // with the tiles below and above the band.
+        TileIndex row = NIL_TILE;
+        for (size_t i = rows.size(); i > 0; i--) {
+            row = rows[i - 1];
+            TileIndex right = pool[row].getRight();
+            if (right != NIL_TILE) {
+                mergeLeft(right);
+            }
+            row = mergeLeft(row);
+            row = mergeDown(row);
+        }
+        mergeUp(row);
 
-            // Merge down
-            ret_tile = mergeDown(tt);
+        return true;
+    }
+    // Area search: returns the first solid tile found inside `area`, or
+    // NIL_TILE if the area is empty. Only the tiles along the left edge of
+    // the area are visited: a space tile that ends before the right edge
+    // must be followed by a solid tile, because space tiles are maximal.
+    TileIndex areaSearch(Rect area) {
+        area = clip(area);
+        if (area.bottom_left.x >= area.top_right.x || area.bottom_left.y >= area.top_right.y) {
+            return NIL_TILE;
         }
-        if (t_left != nullptr) {
-            mergeUp(t_left);
+        TileIndex tile = findTileatPoint({area.bottom_left.x, Coord(area.top_right.y - 1)});
+        while (tile != NIL_TILE) {
+            Rect rect = pool[tile].getRect();
+            if (pool[tile].isTile()) {
+                return tile;
+            }
+            if (rect.top_right.x < area.top_right.x) {
+                return findTileatPoint(tile, {rect.top_right.x, Coord(std::min(rect.top_right.y, area.top_right.y) - 1)});
+            }
+            if (rect.bottom_left.y <= area.bottom_left.y) {
+                return NIL_TILE;
+            }
+            tile = findTileatPoint(tile, {area.bottom_left.x, Coord(rect.bottom_left.y - 1)});
         }
-        if (t_right != nullptr) {
-            mergeUp(t_right);
+        return NIL_TILE;
+    }
+    // Area enumeration: calls visit(tile) once for every tile intersecting
+    // `area`. Each tile is reached from its parent, the tile to its left
+    // that contains its bottom-left corner (clipped to the area), which
+    // makes the tiles a forest rooted at the left edge of the area. The
+    // forest is walked depth first through stitches alone, without a
+    // stack, so the cost is proportional to the number of tiles visited.
+    template <typename Visit>
+    void enumerateArea(Rect area, Visit visit) {
+        area = clip(area);
+        if (area.bottom_left.x >= area.top_right.x || area.bottom_left.y >= area.top_right.y) {
+            return;
         }
+        TileIndex root = findTileatPoint({area.bottom_left.x, Coord(area.top_right.y - 1)});
+        while (root != NIL_TILE) {
+            TileIndex tile = root;
+            for (;;) {
+                visit(tile);
+                Rect rect = pool[tile].getRect();
 
-        return ret_tile;
+                // Descend to the topmost child
+                if (rect.top_right.x < area.top_right.x) {
+                    TileIndex child = findTileatPoint(pool[tile].getRight(), {rect.top_right.x, Coord(std::min(rect.top_right.y, area.top_right.y) - 1)});
+                    if (std::max(pool[child].getRect().bottom_left.y, area.bottom_left.y) >= rect.bottom_left.y) {
+                        tile = child;
+                        continue;
+                    }
+                }
+
+                // Otherwise move to the next sibling, climbing up as long
+                // as the current tile is the last child of its parent
+                while (tile != root) {
+                    Rect tile_rect = pool[tile].getRect();
+                    TileIndex parent = findTileatPoint(pool[tile].getLeft(), {Coord(tile_rect.bottom_left.x - 1), std::max(tile_rect.bottom_left.y, area.bottom_left.y)});
+                    if (tile_rect.bottom_left.y > area.bottom_left.y) {
+                        TileIndex sibling = pool[tile].getBelow();
+                        if (std::max(pool[sibling].getRect().bottom_left.y, area.bottom_left.y) >= pool[parent].getRect().bottom_left.y) {
+                            tile = sibling;
+                            break;
+                        }
+                    }
+                    tile = parent;
+                }
+                if (tile == root) {
+                    break;
+                }
+            }
+
+            Rect root_rect = pool[root].getRect();
+            if (root_rect.bottom_left.y <= area.bottom_left.y) {
+                break;
+            }
+            root = findTileatPoint(root, {area.bottom_left.x, Coord(root_rect.bottom_left.y - 1)});
+        }
+    }
+    // Offline construction: rebuilds the whole plane from the blocks it
+    // already holds plus `new_blocks` in one bottom-to-top sweep, instead
+    // of inserting them one at a time. `row` holds every tile crossing the
+    // current row, keyed by left edge. At each y where blocks start or end,
+    // only the space runs next to those blocks can change: a run whose
+    // extent survives the row grows upward, any other run closes there.
+    // Tiles closing at y and tiles opening at y are exactly the ones that
+    // meet across y, so above/below stitches pair them up, while the row
+    // supplies the right neighbor of a closing tile and the left neighbor
+    // of an opening one. Maximal horizontal stripes are unique for a given
+    // set of blocks, so the plane equals the one incremental insertion
+    // builds. O(n log n).
+    void bulkLoad(const std::vector<BlockRect>& new_blocks) {
+        thaw();
+        std::vector<BlockRect> solids;
+        solids.reserve(block_ids.size() + new_blocks.size());
+        for (const std::pair<const int, TileIndex>& block : block_ids) {
+            solids.push_back({pool[block.second].getRect(), block.first});
+        }
+        solids.insert(solids.end(), new_blocks.begin(), new_blocks.end());
+
+        pool = TilePool<Coord>();
+        blocks = TileRegistry();
+        block_ids.clear();
+        std::vector<TileIndex> solid_tiles(solids.size());
+        for (size_t i = 0; i < solids.size(); i++) {
+            solid_tiles[i] = pool.allocate(solids[i].rect, solids[i].id);
+            blocks.insert(solid_tiles[i]);
+            block_ids[solids[i].id] = solid_tiles[i];
+        }
+
+        // Rows change where a block starts or ends
+        std::vector<std::pair<Coord, size_t>> events;
+        events.reserve(2 * solids.size());
+        for (size_t i = 0; i < solids.size(); i++) {
+            events.push_back({solids[i].rect.bottom_left.y, i});
+            events.push_back({solids[i].rect.top_right.y, i});
+        }
+        std::sort(events.begin(), events.end());
+
+        std::map<Coord, Coord> active;          // left -> right of solids in the row
+        std::map<Coord, TileIndex> row;       // left -> every tile in the row
+        std::vector<std::pair<Coord, Coord>> dirty;
+        std::vector<std::pair<Coord, Coord>> gaps;
+        std::vector<std::pair<Coord, Coord>> new_runs;
+        std::vector<TileIndex> closing;
+        std::vector<TileIndex> opening;
+        size_t e = 0;
+        for (Coord y = 0; ; ) {
+            closing.clear();
+            opening.clear();
+            dirty.clear();
+            new_runs.clear();
+            if (y == 0) {
+                dirty.push_back({0, width});
+            }
+
+            if (y >= height) {
+                for (const std::pair<const Coord, TileIndex>& entry : row) {
+                    closing.push_back(entry.second);
+                }
+            } else {
+                // Blocks ending here leave before the ones starting here,
+                // which may reuse their left edge
+                size_t row_end = e;
+                for (; row_end < events.size() && events[row_end].first == y; row_end++) {
+                    size_t i = events[row_end].second;
+                    Rect rect = solids[i].rect;
+                    if (rect.top_right.y == y) {
+                        active.erase(rect.bottom_left.x);
+                        closing.push_back(solid_tiles[i]);
+                    }
+                    dirty.push_back({rect.bottom_left.x, rect.top_right.x});
+                }
+                for (; e < row_end; e++) {
+                    size_t i = events[e].second;
+                    Rect rect = solids[i].rect;
+                    if (rect.bottom_left.y == y) {
+                        active[rect.bottom_left.x] = rect.top_right.x;
+                        opening.push_back(solid_tiles[i]);
+                    }
+                }
+                std::sort(dirty.begin(), dirty.end());
+
+                for (size_t d = 0; d < dirty.size(); ) {
+                    Coord l = dirty[d].first;
+                    Coord r = dirty[d].second;
+                    for (d++; d < dirty.size() && dirty[d].first <= r; d++) {
+                        r = std::max(r, dirty[d].second);
+                    }
+
+                    // Space gaps of row y touching [l, r]
+                    gaps.clear();
+                    typename std::map<Coord, Coord>::iterator solid = active.lower_bound(l);
+                    Coord gap_left = solid == active.begin() ? 0 : std::prev(solid)->second;
+                    for (;;) {
+                        Coord gap_right = solid == active.end() ? width : solid->first;
+                        if (gap_left < gap_right && gap_left <= r && gap_right >= l) {
+                            gaps.push_back({gap_left, gap_right});
+                        }
+                        if (solid == active.end() || solid->first > r) {
+                            break;
+                        }
+                        gap_left = solid->second;
+                        ++solid;
+                    }
+
+                    // Space runs touching [l, r] that do not survive close at y;
+                    // their top is set right away so a second interval skips them
+                    typename std::map<Coord, TileIndex>::iterator entry = row.upper_bound(r);
+                    while (entry != row.begin()) {
+                        --entry;
+                        Tile& tile = pool[entry->second];
+                        Rect rect = tile.getRect();
+                        if (rect.top_right.x < l) {
+                            break;
+                        }
+                        if (!tile.isSpace() || rect.top_right.y == y) {
+                            continue;
+                        }
+                        if (!std::binary_search(gaps.begin(), gaps.end(), std::make_pair(rect.bottom_left.x, rect.top_right.x))) {
+                            rect.top_right.y = y;
+                            tile.setRect(rect);
+                            closing.push_back(entry->second);
+                        }
+                    }
+                    new_runs.insert(new_runs.end(), gaps.begin(), gaps.end());
+                }
+            }
+
+            // Right stitches come from the row as it was below y
+            for (TileIndex tile : closing) {
+                typename std::map<Coord, TileIndex>::iterator next = row.upper_bound(pool[tile].getRect().bottom_left.x);
+                pool[tile].setRight(next == row.end() ? NIL_TILE : next->second);
+            }
+            for (TileIndex tile : closing) {
+                row.erase(pool[tile].getRect().bottom_left.x);
+            }
+
+            // Open the gaps that do not continue a surviving run
+            std::sort(new_runs.begin(), new_runs.end());
+            new_runs.erase(std::unique(new_runs.begin(), new_runs.end()), new_runs.end());
+            for (const std::pair<Coord, Coord>& run : new_runs) {
+                typename std::map<Coord, TileIndex>::iterator entry = row.find(run.first);
+                if (entry == row.end() || pool[entry->second].getRect().top_right.x != run.second) {
+                    TileIndex tile = pool.allocate({{run.second, height}, {run.first, y}}, -1);
+                    blocks.insert(tile);
+                    opening.push_back(tile);
+                }
+            }
+            for (TileIndex tile : opening) {
+                row[pool[tile].getRect().bottom_left.x] = tile;
+            }
+
+            // Left stitches come from the row as it is above y
+            for (TileIndex tile : opening) {
+                typename std::map<Coord, TileIndex>::iterator self = row.find(pool[tile].getRect().bottom_left.x);
+                pool[tile].setLeft(self == row.begin() ? NIL_TILE : std::prev(self)->second);
+            }
+
+            // Tiles ending at y sit right below the tiles starting at y
+            stitchAcross(closing, opening);
+            if (y == 0) {
+                start = opening.front();
+            }
+
+            if (y >= height) {
+                break;
+            }
+            y = e < events.size() ? std::min(events[e].first, height) : height;
+        }
+
+        resetLocator();
+        if (tracking_neighbors) {
+            recountNeighbors();
+        }
+        STATS(stats.notePeak(pool.size());)
+    }
+    // Builds the plane from the blocks it already holds plus `new_blocks`
+    // on several threads. The outline is cut into horizontal bands holding
+    // about the same number of blocks; each band is an independent Outline
+    // in its own coordinates, and a block crossing a band edge is inserted
+    // into every band it touches, cut at the edges. The bands are then
+    // copied into this plane with their y offset, the rows on either side
+    // of each seam are stitched together, and every tile just above a seam
+    // is merged down when the tile below it has the same span and id. That
+    // rejoins cut blocks and space tiles, so the result is the same
+    // canonical plane a single Outline builds.
+    void shardedLoad(const std::vector<BlockRect>& new_blocks, unsigned shards, unsigned threads) {
+        thaw();
+        // The seam merges below run on a pool the counts were not sized
+        // for; the counts are rebuilt once the plane is complete.
+        bool was_tracking = tracking_neighbors;
+        tracking_neighbors = false;
+        std::vector<BlockRect> solids;
+        solids.reserve(block_ids.size() + new_blocks.size());
+        for (const std::pair<const int, TileIndex>& block : block_ids) {
+            solids.push_back({pool[block.second].getRect(), block.first});
+        }
+        solids.insert(solids.end(), new_blocks.begin(), new_blocks.end());
+
+        // Band edges at quantiles of the block bottoms
+        std::vector<Coord> bottoms;
+        bottoms.reserve(solids.size());
+        for (const BlockRect& solid : solids) {
+            bottoms.push_back(solid.rect.bottom_left.y);
+        }
+        std::sort(bottoms.begin(), bottoms.end());
+        std::vector<Coord> edges(1, 0);
+        for (unsigned k = 1; k < shards && !bottoms.empty(); k++) {
+            Coord edge = bottoms[bottoms.size() * k / shards];
+            if (edge > edges.back() && edge < height) {
+                edges.push_back(edge);
+            }
+        }
+        edges.push_back(height);
+        size_t bands = edges.size() - 1;
+
+        std::vector<std::vector<BlockRect>> pieces(bands);
+        for (const BlockRect& solid : solids) {
+            size_t band = std::upper_bound(edges.begin(), edges.end(), solid.rect.bottom_left.y) - edges.begin() - 1;
+            for (; band < bands && edges[band] < solid.rect.top_right.y; band++) {
+                Rect piece = solid.rect;
+                piece.bottom_left.y = std::max(piece.bottom_left.y, edges[band]) - edges[band];
+                piece.top_right.y = std::min(piece.top_right.y, edges[band + 1]) - edges[band];
+                pieces[band].push_back({piece, solid.id});
+            }
+        }
+
+        std::vector<std::unique_ptr<BasicOutline>> planes(bands);
+        parallelFor(bands, 1, threads, [&](size_t begin, size_t end) {
+            for (size_t band = begin; band < end; band++) {
+                planes[band].reset(new BasicOutline(width, edges[band + 1] - edges[band]));
+                for (const BlockRect& piece : pieces[band]) {
+                    planes[band]->createBlock(piece.rect, piece.id);
+                }
+                std::vector<BlockRect>().swap(pieces[band]);
+            }
+        });
+
+        // Copy the bands in, each into its own range of slots, keeping the
+        // rows that meet at each seam
+        pool = TilePool<Coord>();
+        blocks = TileRegistry();
+        block_ids.clear();
+        std::vector<TileIndex> first_slot(bands + 1, 0);
+        for (size_t band = 0; band < bands; band++) {
+            first_slot[band + 1] = first_slot[band] + planes[band]->blocks.size();
+        }
+        pool.allocateRange(first_slot[bands]);
+        std::vector<std::vector<TileIndex>> below_seam(bands);
+        std::vector<std::vector<TileIndex>> above_seam(bands);
+        parallelFor(bands, 1, threads, [&](size_t begin, size_t end) {
+            for (size_t band = begin; band < end; band++) {
+                BasicOutline& plane = *planes[band];
+                std::vector<TileIndex> remap(plane.pool.slotCount(), NIL_TILE);
+                TileIndex next = first_slot[band];
+                for (TileIndex tile : plane.blocks) {
+                    remap[tile] = next++;
+                }
+                auto moved = [&remap](TileIndex tile) {
+                    return tile == NIL_TILE ? NIL_TILE : remap[tile];
+                };
+                for (TileIndex tile : plane.blocks) {
+                    Tile& from = plane.pool[tile];
+                    Rect rect = from.getRect();
+                    rect.bottom_left.y += edges[band];
+                    rect.top_right.y += edges[band];
+                    Tile& to = pool[remap[tile]];
+                    to = Tile(rect, from.getId());
+                    to.setAbove(moved(from.getAbove()));
+                    to.setRight(moved(from.getRight()));
+                    to.setBelow(moved(from.getBelow()));
+                    to.setLeft(moved(from.getLeft()));
+                    if (rect.bottom_left.y == edges[band] && band > 0) {
+                        above_seam[band].push_back(remap[tile]);
+                    }
+                    if (rect.top_right.y == edges[band + 1] && band + 1 < bands) {
+                        below_seam[band + 1].push_back(remap[tile]);
+                    }
+                }
+                if (band == 0) {
+                    start = remap[plane.start];
+                }
+                planes[band].reset();
+            }
+        });
+        for (TileIndex tile = 0; tile < first_slot[bands]; tile++) {
+            blocks.insert(tile);
+        }
+
+        for (size_t band = 1; band < bands; band++) {
+            stitchAcross(below_seam[band], above_seam[band]);
+        }
+        for (size_t band = 1; band < bands; band++) {
+            for (TileIndex tile : above_seam[band]) {
+                mergeDown(tile);
+            }
+        }
+
+        for (TileIndex tile : blocks) {
+            if (pool[tile].isTile()) {
+                block_ids[pool[tile].getId()] = tile;
+            }
+        }
+        resetLocator();
+        tracking_neighbors = was_tracking;
+        if (tracking_neighbors) {
+            recountNeighbors();
+        }
+        STATS(stats.notePeak(pool.size());)
     }
-    NeighborCount neighborFinding(Tile* tile) {
+
+    // Writes the plane as a binary snapshot (see snapshot.h). Live tiles
+    // are renumbered densely in pool order, so free slots are not saved.
+    // Records hold 32-bit coordinates; a wider plane cannot be saved.
+    bool saveSnapshot(const std::string& path) {
+        if ((long long)width > INT32_MAX || (long long)height > INT32_MAX) {
+            return false;
+        }
+        std::vector<TileIndex> live(blocks.begin(), blocks.end());
+        std::sort(live.begin(), live.end());
+        std::vector<uint32_t> record(pool.slotCount(), NIL_TILE);
+        for (size_t i = 0; i < live.size(); i++) {
+            record[live[i]] = i;
+        }
+        auto recordOf = [&record](TileIndex tile) {
+            return tile == NIL_TILE ? NIL_TILE : record[tile];
+        };
+
+        SnapshotHeader header;
+        std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+        header.version = SNAPSHOT_VERSION;
+        header.byte_order = SNAPSHOT_BYTE_ORDER;
+        header.width = width;
+        header.height = height;
+        header.tile_count = live.size();
+        header.block_count = block_ids.size();
+        header.start = record[start];
+        header.reserved = 0;
+
+        OutputWriter output;
+        if (!output.open(path, false)) {
+            return false;
+        }
+        output.write(std::string(reinterpret_cast<const char*>(&header), sizeof(header)));
+        std::string records;
+        for (TileIndex tile : live) {
+            Tile& t = pool[tile];
+            Rect rect = t.getRect();
+            SnapshotTile entry = {
+                int32_t(rect.bottom_left.x), int32_t(rect.bottom_left.y), int32_t(rect.top_right.x), int32_t(rect.top_right.y), t.getId(),
+                recordOf(t.getAbove()), recordOf(t.getRight()), recordOf(t.getBelow()), recordOf(t.getLeft())
+            };
+            records.append(reinterpret_cast<const char*>(&entry), sizeof(entry));
+            if (records.size() >= (size_t(1) << 20)) {
+                output.write(records);
+                records.clear();
+            }
+        }
+        for (const std::pair<const int, TileIndex>& block : block_ids) {
+            SnapshotBlock entry = {block.first, record[block.second]};
+            records.append(reinterpret_cast<const char*>(&entry), sizeof(entry));
+            if (records.size() >= (size_t(1) << 20)) {
+                output.write(records);
+                records.clear();
+            }
+        }
+        output.write(records);
+        return output.close();
+    }
+
+    // Replaces the whole plane with the contents of a snapshot. Records
+    // keep their numbers as tile indices, so stitches are copied as is and
+    // the sorted block table fills block_ids without rebalancing. The load
+    // is a copy: records store 64-bit coordinates whatever Coord is, so the
+    // pool pages cannot point into the mapping. The slots are allocated in
+    // one range and the records written straight into them.
+    void loadSnapshot(const SnapshotFile& snapshot) {
+        const SnapshotHeader& header = snapshot.getHeader();
+        thaw();
+        width = Coord(header.width);
+        height = Coord(header.height);
+        pool = TilePool<Coord>();
+        blocks = TileRegistry();
+        block_ids.clear();
+
+        pool.allocateRange(header.tile_count);
+        blocks.reserve(header.tile_count);
+        const SnapshotTile* record = snapshot.tiles();
+        for (TileIndex tile = 0; tile < header.tile_count; tile++, record++) {
+            Tile& t = pool[tile];
+            t = Tile({{Coord(record->right), Coord(record->top)}, {Coord(record->left), Coord(record->bottom)}}, record->id);
+            t.setAbove(record->above_stitch);
+            t.setRight(record->right_stitch);
+            t.setBelow(record->below_stitch);
+            t.setLeft(record->left_stitch);
+            blocks.insert(tile);
+        }
+        const SnapshotBlock* block = snapshot.blocks();
+        for (uint32_t i = 0; i < header.block_count; i++, block++) {
+            block_ids.emplace_hint(block_ids.end(), block->id, block->tile);
+        }
+
+        start = header.start;
+        initLocator();
+        resetLocator();
+        if (tracking_neighbors) {
+            recountNeighbors();
+        }
+        STATS(stats.notePeak(pool.size());)
+    }
+    // Calls visit(neighbor) for every tile sharing a stretch of `side` of
+    // `tile`: along the top from right to left, down the right side, along
+    // the bottom from left to right and up the left side.
+    template <typename Visit>
+    void forEachNeighbor(TileIndex tile, Side side, Visit visit) {
+        Rect rect = pool[tile].getRect();
+        if (side == ABOVE) {
+            for (TileIndex tile_it = pool[tile].getAbove(); tile_it != NIL_TILE && pool[tile_it].getRect().top_right.x > rect.bottom_left.x; tile_it = pool[tile_it].getLeft()) {
+                visit(tile_it);
+            }
+        } else
+        if (side == RIGHT) {
+            for (TileIndex tile_it = pool[tile].getRight(); tile_it != NIL_TILE && pool[tile_it].getRect().top_right.y > rect.bottom_left.y; tile_it = pool[tile_it].getBelow()) {
+                visit(tile_it);
+            }
+        } else
+        if (side == BELOW) {
+            for (TileIndex tile_it = pool[tile].getBelow(); tile_it != NIL_TILE && pool[tile_it].getRect().bottom_left.x < rect.top_right.x; tile_it = pool[tile_it].getRight()) {
+                visit(tile_it);
+            }
+        } else {
+            for (TileIndex tile_it = pool[tile].getLeft(); tile_it != NIL_TILE && pool[tile_it].getRect().bottom_left.y < rect.top_right.y; tile_it = pool[tile_it].getAbove()) {
+                visit(tile_it);
+            }
+        }
+    }
+    // Calls visit(neighbor) for every tile sharing a stretch of edge with
+    // `tile`, side by side in the order of Side.
+    template <typename Visit>
+    void forEachNeighbor(TileIndex tile, Visit visit) {
+        forEachNeighbor(tile, ABOVE, visit);
+        forEachNeighbor(tile, RIGHT, visit);
+        forEachNeighbor(tile, BELOW, visit);
+        forEachNeighbor(tile, LEFT, visit);
+    }
+    NeighborCount neighborFinding(TileIndex tile) {
         // Protection
-        if (tile == nullptr) {
+        if (tile == NIL_TILE) {
             return {0, 0};
         }
 
         int solid_count = 0;
         int space_count = 0;
-
-        // Check above
-        for (Tile* tile_it = tile->getAbove(); tile_it != nullptr && tile_it->getRect().top_right.x > tile->getRect().bottom_left.x; tile_it = tile_it->getLeft()) {
-            if (tile_it->getId() == -1) {
+        forEachNeighbor(tile, [&](TileIndex neighbor) {
+            if (pool[neighbor].getId() == -1) {
                 space_count++;
             } else {
                 solid_count++;
             }
+        });
+
+        STATS(stats.neighbor_calls.fetch_add(1, std::memory_order_relaxed);)
+        STATS(stats.neighbor_tiles.fetch_add(solid_count + space_count, std::memory_order_relaxed);)
+        return {solid_count, space_count};
+    }
+
+    //================================================================
+    // Spacing Queries
+    //================================================================
+    // Nearest solid tile beyond `side` of `from`, looking only across the
+    // stretch [low, high) of that side, with distances measured from the
+    // line `origin`. The tiles in between are visited in order of their
+    // distance, so the first solid one taken from the queue is the
+    // nearest. A tile is only queued by the tile on its near side that
+    // holds the start of its stretch, which queues it once. The cost
+    // depends on the tiles between the source and the obstacle, not on
+    // the size of the plane.
+    Obstacle nearestSolid(TileIndex from, Side side, Coord low, Coord high, Coord origin) {
+        bool vertical = side == ABOVE || side == BELOW;
+        auto distance = [&](Rect rect) -> long long {
+            if (side == ABOVE) {
+                return (long long)rect.bottom_left.y - origin;
+            }
+            if (side == RIGHT) {
+                return (long long)rect.bottom_left.x - origin;
+            }
+            if (side == BELOW) {
+                return (long long)origin - rect.top_right.y;
+            }
+            return (long long)origin - rect.top_right.x;
+        };
+
+        // Ordered by distance, then by position along the side
+        typedef std::pair<std::pair<long long, Coord>, TileIndex> Entry;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+        auto expand = [&](TileIndex tile) {
+            Rect rect = pool[tile].getRect();
+            Coord tile_low = vertical ? rect.bottom_left.x : rect.bottom_left.y;
+            Coord tile_high = vertical ? rect.top_right.x : rect.top_right.y;
+            forEachNeighbor(tile, side, [&](TileIndex neighbor) {
+                Rect neighbor_rect = pool[neighbor].getRect();
+                Coord neighbor_low = vertical ? neighbor_rect.bottom_left.x : neighbor_rect.bottom_left.y;
+                Coord neighbor_high = vertical ? neighbor_rect.top_right.x : neighbor_rect.top_right.y;
+                Coord stretch_start = std::max(neighbor_low, low);
+                if (neighbor_high > low && neighbor_low < high && stretch_start >= tile_low && stretch_start < tile_high) {
+                    queue.push({{distance(neighbor_rect), neighbor_low}, neighbor});
+                }
+            });
+        };
+
+        expand(from);
+        while (!queue.empty()) {
+            Entry nearest = queue.top();
+            queue.pop();
+            if (pool[nearest.second].isTile()) {
+                return {nearest.second, nearest.first.first};
+            }
+            expand(nearest.second);
+        }
+        if (side == ABOVE) {
+            return {NIL_TILE, (long long)height - origin};
         }
+        if (side == RIGHT) {
+            return {NIL_TILE, (long long)width - origin};
+        }
+        return {NIL_TILE, (long long)origin};
+    }
 
-        // Check right
-        for (Tile* tile_it = tile->getRight(); tile_it != nullptr && tile_it->getRect().top_right.y > tile->getRect().bottom_left.y; tile_it = tile_it->getBelow()) {
-            if (tile_it->getId() == -1) {
-                space_count++;
-            } else {
-                solid_count++;
+    // Nearest obstacle on `side` of the unit cell whose bottom-left corner
+    // is `point`, which must lie inside the outline. A point inside a
+    // block has that block as its obstacle on every side, at distance 0.
+    Obstacle nearestObstacle(Point point, Side side) {
+        TileIndex tile = findTileatPoint(point);
+        if (pool[tile].isTile()) {
+            return {tile, 0};
+        }
+        if (side == ABOVE || side == BELOW) {
+            return nearestSolid(tile, side, point.x, Coord(point.x + 1), side == ABOVE ? Coord(point.y + 1) : point.y);
+        }
+        return nearestSolid(tile, side, point.y, Coord(point.y + 1), side == RIGHT ? Coord(point.x + 1) : point.x);
+    }
+
+    // Nearest obstacle facing any part of `side` of a block
+    Obstacle nearestObstacle(TileIndex block, Side side) {
+        Rect rect = pool[block].getRect();
+        if (side == ABOVE) {
+            return nearestSolid(block, side, rect.bottom_left.x, rect.top_right.x, rect.top_right.y);
+        }
+        if (side == RIGHT) {
+            return nearestSolid(block, side, rect.bottom_left.y, rect.top_right.y, rect.top_right.x);
+        }
+        if (side == BELOW) {
+            return nearestSolid(block, side, rect.bottom_left.x, rect.top_right.x, rect.bottom_left.y);
+        }
+        return nearestSolid(block, side, rect.bottom_left.y, rect.top_right.y, rect.bottom_left.x);
+    }
+
+    // Minimum-spacing check: calls visit(block, other, gap) for every pair
+    // of blocks closer than `distance`, the smaller id first, in id order.
+    // The gap is the larger of the horizontal and vertical free distance
+    // between the two, 0 when they touch. Every block enumerates only the
+    // tiles of its surroundings grown by `distance`, so the cost follows
+    // the local density of the layout instead of growing with every pair.
+    template <typename Visit>
+    void forEachClosePair(long long distance, Visit visit) {
+        std::vector<std::pair<int, TileIndex>> close;
+        for (const std::pair<const int, TileIndex>& block : block_ids) {
+            Rect rect = pool[block.second].getRect();
+            BasicRect<long long> around = {
+                {rect.top_right.x + distance, rect.top_right.y + distance},
+                {rect.bottom_left.x - distance, rect.bottom_left.y - distance}
+            };
+            close.clear();
+            enumerateArea(narrow(around), [&](TileIndex tile) {
+                if (pool[tile].isTile() && pool[tile].getId() > block.first) {
+                    close.push_back({pool[tile].getId(), tile});
+                }
+            });
+            std::sort(close.begin(), close.end());
+            for (const std::pair<int, TileIndex>& other : close) {
+                Rect other_rect = pool[other.second].getRect();
+                long long gap_x = std::max({0LL, (long long)other_rect.bottom_left.x - rect.top_right.x, (long long)rect.bottom_left.x - other_rect.top_right.x});
+                long long gap_y = std::max({0LL, (long long)other_rect.bottom_left.y - rect.top_right.y, (long long)rect.bottom_left.y - other_rect.top_right.y});
+                visit(block.second, other.second, std::max(gap_x, gap_y));
             }
         }
+    }
 
-        // Check below
-        for (Tile* tile_it = tile->getBelow(); tile_it != nullptr && tile_it->getRect().bottom_left.x < tile->getRect().top_right.x; tile_it = tile_it->getRight()) {
-            if (tile_it->getId() == -1) {
-                space_count++;
-            } else {
-                solid_count++;
+    //================================================================
+    // Drawing Order
+    //================================================================
+    // The space tiles in the order the original list-based plane kept
+    // them, given the blocks it was built from in input order. That plane
+    // appended every tile it split off and stable-sorted the list by id
+    // for the drawing. A split keeps the lower or left piece and a merge
+    // keeps the lower tile, so a tile never changes its bottom-left
+    // corner, and each final space tile is the one last split off at its
+    // corner. The blocks are replayed on a scratch plane to date those
+    // splits: above the block's top edge, above its bottom edge, and right
+    // of its right edge on every row it crosses. Tiles with no dated
+    // corner follow, bottom to top and left to right.
+    std::vector<TileIndex> spaceTilesInListOrder(const std::vector<BlockRect>& history) {
+        struct Split
+        {
+            Coord y;
+            Coord x;
+            size_t order;
+            bool operator<(const Split& other) const {
+                return std::tie(y, x, order) < std::tie(other.y, other.x, other.order);
+            }
+        };
+        std::vector<Split> splits(1, {0, 0, 0});
+        BasicOutline replay(width, height);
+        for (const BlockRect& block : history) {
+            Rect rect = block.rect;
+            if (rect.top_right.y < height) {
+                Rect above = replay.pool[replay.findTileatPoint({rect.bottom_left.x, rect.top_right.y})].getRect();
+                if (above.bottom_left.y < rect.top_right.y) {
+                    splits.push_back({rect.top_right.y, above.bottom_left.x, splits.size()});
+                }
             }
+            TileIndex row = replay.findTileatPoint(rect.bottom_left);
+            if (replay.pool[row].getRect().bottom_left.y < rect.bottom_left.y) {
+                splits.push_back({rect.bottom_left.y, replay.pool[row].getRect().bottom_left.x, splits.size()});
+            }
+            for (;;) {
+                Rect strip = replay.pool[row].getRect();
+                if (strip.top_right.x > rect.top_right.x) {
+                    splits.push_back({std::max(strip.bottom_left.y, rect.bottom_left.y), rect.top_right.x, splits.size()});
+                }
+                if (strip.top_right.y >= rect.top_right.y) {
+                    break;
+                }
+                row = replay.findTileatPoint(row, {rect.bottom_left.x, strip.top_right.y});
+            }
+            replay.createBlock(rect, block.id);
         }
+        std::sort(splits.begin(), splits.end());
 
-        // Check left
-        for (Tile* tile_it = tile->getLeft(); tile_it != nullptr && tile_it->getRect().bottom_left.y < tile->getRect().top_right.y; tile_it = tile_it->getAbove()) {
-            if (tile_it->getId() == -1) {
-                space_count++;
-            } else {
-                solid_count++;
+        // Last split at the corner of each space tile; undated tiles last
+        std::vector<std::pair<Split, TileIndex>> dated;
+        for (TileIndex tile : blocks) {
+            if (!pool[tile].isSpace()) {
+                continue;
             }
+            Point corner = pool[tile].getRect().bottom_left;
+            Split key = {corner.y, corner.x, SIZE_MAX};
+            auto last = std::lower_bound(splits.begin(), splits.end(), key);
+            size_t order = SIZE_MAX;
+            if (last != splits.begin() && (last - 1)->y == corner.y && (last - 1)->x == corner.x) {
+                order = (last - 1)->order;
+            }
+            dated.push_back({{corner.y, corner.x, order}, tile});
+        }
+        std::sort(dated.begin(), dated.end(), [](const std::pair<Split, TileIndex>& a, const std::pair<Split, TileIndex>& b) {
+            return std::tie(a.first.order, a.first.y, a.first.x) < std::tie(b.first.order, b.first.y, b.first.x);
+        });
+        std::vector<TileIndex> order;
+        order.reserve(dated.size());
+        for (const std::pair<Split, TileIndex>& tile : dated) {
+            order.push_back(tile.second);
         }
+        return order;
+    }
 
-        return {solid_count, space_count};
+    //================================================================
+    // Density Maps
+    //================================================================
+    // Accumulators of all chunks of a density map stay within this many
+    // values; larger maps are summed by fewer threads.
+    static const size_t DENSITY_MAP_BUDGET = size_t(1) << 23;
+
+    // Utilization, tile and space maps of the outline on `columns` x
+    // `rows` bins (see DensityMap), at most one bin per unit, in one pass
+    // over the tiles on `threads` threads. A tile straddling bin edges is
+    // split by the exact area it overlaps each bin with. Every chunk of
+    // the registry sums into its own bins; the chunks are then added up
+    // row by row.
+    DensityMap densityMap(int columns, int rows, unsigned threads) {
+        columns = int(std::max(1LL, std::min<long long>(columns, width)));
+        rows = int(std::max(1LL, std::min<long long>(rows, height)));
+        DensityMap map(columns, rows, width, height);
+        unshare();
+
+        std::vector<double> x_edges(columns + 1);
+        std::vector<double> y_edges(rows + 1);
+        for (int column = 0; column <= columns; column++) {
+            x_edges[column] = double(width) * column / columns;
+        }
+        for (int row = 0; row <= rows; row++) {
+            y_edges[row] = double(height) * row / rows;
+        }
+        // Bins [first, last] that the span [low, high) overlaps
+        auto binSpan = [](const std::vector<double>& edges, double low, double high, int& first, int& last) {
+            int count = int(edges.size()) - 1;
+            first = std::max(0, std::min(count - 1, int(low / edges.back() * count)));
+            while (first > 0 && edges[first] > low) {
+                first--;
+            }
+            while (first + 1 < count && edges[first + 1] <= low) {
+                first++;
+            }
+            last = first;
+            while (last + 1 < count && edges[last + 1] < high) {
+                last++;
+            }
+        };
+
+        // Three sums per bin: block area, tile share, space tile share
+        size_t bins = size_t(columns) * rows;
+        size_t chunks = std::max<size_t>(1, std::min<size_t>({size_t(threads), DENSITY_MAP_BUDGET / (3 * bins), blocks.size() / 4096 + 1}));
+        size_t grain = (blocks.size() + chunks - 1) / chunks;
+        std::vector<std::vector<double>> sums(chunks);
+        const TileIndex* tiles = &*blocks.begin();
+        parallelFor(blocks.size(), grain, threads, [&](size_t begin, size_t end) {
+            std::vector<double>& sum = sums[begin / grain];
+            sum.assign(3 * bins, 0.0);
+            for (size_t i = begin; i < end; i++) {
+                Tile& tile = pool[tiles[i]];
+                Rect rect = tile.getRect();
+                double left = rect.bottom_left.x;
+                double right = rect.top_right.x;
+                double bottom = rect.bottom_left.y;
+                double top = rect.top_right.y;
+                double area = (right - left) * (top - bottom);
+                bool solid = tile.isTile();
+                int first_column, last_column, first_row, last_row;
+                binSpan(x_edges, left, right, first_column, last_column);
+                binSpan(y_edges, bottom, top, first_row, last_row);
+                for (int row = first_row; row <= last_row; row++) {
+                    double overlap_y = std::min(top, y_edges[row + 1]) - std::max(bottom, y_edges[row]);
+                    double* bin = sum.data() + 3 * (size_t(row) * columns + first_column);
+                    for (int column = first_column; column <= last_column; column++, bin += 3) {
+                        double overlap = overlap_y * (std::min(right, x_edges[column + 1]) - std::max(left, x_edges[column]));
+                        if (solid) {
+                            bin[0] += overlap;
+                        } else {
+                            bin[2] += overlap / area;
+                        }
+                        bin[1] += overlap / area;
+                    }
+                }
+            }
+        });
+
+        size_t used = (blocks.size() + grain - 1) / grain;
+        parallelFor(rows, 1, threads, [&](size_t begin, size_t end) {
+            for (size_t row = begin; row < end; row++) {
+                double bin_height = y_edges[row + 1] - y_edges[row];
+                for (int column = 0; column < columns; column++) {
+                    size_t bin = row * columns + column;
+                    double solid = 0, share = 0, space_share = 0;
+                    for (size_t chunk = 0; chunk < used; chunk++) {
+                        solid += sums[chunk][3 * bin];
+                        share += sums[chunk][3 * bin + 1];
+                        space_share += sums[chunk][3 * bin + 2];
+                    }
+                    map.getUtilization()[bin] = float(solid / (bin_height * (x_edges[column + 1] - x_edges[column])));
+                    map.getTiles()[bin] = float(share);
+                    map.getSpace()[bin] = float(space_share);
+                }
+            }
+        });
+        return map;
     }
 
 };
 
-#endif
\ No newline at end of file
+extern template class BasicOutline<int16_t>;
+extern template class BasicOutline<int32_t>;
+extern template class BasicOutline<int64_t>;
+
+#endif
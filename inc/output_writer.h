@@ -0,0 +1,203 @@
+#ifndef _OUTPUT_WRITER_H
+#define _OUTPUT_WRITER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+// Appends the decimal form of value to out without going through streams.
+inline void appendInt(std::string& out, long long value) {
+    char digits[24];
+    char* it = digits + sizeof(digits);
+    unsigned long long magnitude = value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+    do {
+        *--it = char('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0) {
+        *--it = '-';
+    }
+    out.append(it, digits + sizeof(digits) - it);
+}
+
+// Buffered writer for the result and drawing files. Text is collected in
+// a large buffer and handed to write(2) only when the buffer is full or
+// on close(), instead of being flushed line by line.
+//
+// In asynchronous mode full buffers are queued to a background thread,
+// so the caller can format the next phase while the previous one is
+// still being written out.
+class OutputWriter {
+private:
+    static const size_t BUFFER_SIZE = size_t(1) << 22;
+    static const size_t MAX_PENDING = 2;
+
+    int fd;
+    bool failed;
+    std::string buffer;
+
+    bool async;
+    std::thread flusher;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::string> pending;
+    bool closing;
+
+    void writeAll(const std::string& data) {
+        const char* it = data.data();
+        size_t left = data.size();
+        while (left > 0 && !failed) {
+            ssize_t written = ::write(fd, it, left);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written < 0) {
+                failed = true;
+                break;
+            }
+            it += written;
+            left -= written;
+        }
+    }
+
+    void flushLoop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            changed.wait(lock, [this]() { return closing || !pending.empty(); });
+            if (pending.empty()) {
+                return;
+            }
+            std::string data;
+            data.swap(pending.front());
+            lock.unlock();
+            writeAll(data);
+            lock.lock();
+            pending.pop_front();
+            changed.notify_all();
+        }
+    }
+
+    void flushBuffer() {
+        if (buffer.empty()) {
+            return;
+        }
+        if (!async) {
+            writeAll(buffer);
+            buffer.clear();
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this]() { return pending.size() < MAX_PENDING; });
+        pending.emplace_back();
+        pending.back().swap(buffer);
+        changed.notify_all();
+        lock.unlock();
+        buffer.reserve(BUFFER_SIZE);
+    }
+
+public:
+    //================================================================
+    // Constructors and Destructors
+    //================================================================
+    OutputWriter(): fd(-1), failed(false), async(false), closing(false) {}
+    ~OutputWriter() {
+        close();
+    }
+    OutputWriter(const OutputWriter&) = delete;
+    OutputWriter& operator=(const OutputWriter&) = delete;
+
+    //================================================================
+    // Getters and Setters
+    //================================================================
+    bool good() const {
+        return fd >= 0 && !failed;
+    }
+
+    //================================================================
+    // Public Methods
+    //================================================================
+    // An empty path writes to stdout.
+    bool open(const std::string& path, bool asynchronous) {
+        fd = path.empty() ? 1 : ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        buffer.reserve(BUFFER_SIZE);
+        async = asynchronous;
+        if (async) {
+            flusher = std::thread(&OutputWriter::flushLoop, this);
+        }
+        return true;
+    }
+
+    // Flushes everything and waits for the background thread. Returns
+    // false if any write failed.
+    bool close() {
+        if (fd < 0) {
+            return !failed;
+        }
+        flushBuffer();
+        if (async) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                closing = true;
+            }
+            changed.notify_all();
+            flusher.join();
+            async = false;
+        }
+        if (fd > 1) {
+            ::close(fd);
+        }
+        fd = -1;
+        return !failed;
+    }
+
+    OutputWriter& write(const std::string& text) {
+        if (buffer.size() + text.size() > BUFFER_SIZE) {
+            flushBuffer();
+        }
+        if (text.size() >= BUFFER_SIZE) {
+            std::string large(text);
+            buffer.swap(large);
+            flushBuffer();
+            return *this;
+        }
+        buffer += text;
+        return *this;
+    }
+
+    OutputWriter& write(char c) {
+        if (buffer.size() + 1 > BUFFER_SIZE) {
+            flushBuffer();
+        }
+        buffer += c;
+        return *this;
+    }
+
+    OutputWriter& write(long long value) {
+        if (buffer.size() + 24 > BUFFER_SIZE) {
+            flushBuffer();
+        }
+        appendInt(buffer, value);
+        return *this;
+    }
+
+    OutputWriter& write(int value) {
+        return write((long long)value);
+    }
+
+    OutputWriter& write(size_t value) {
+        return write((long long)value);
+    }
+};
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef _PARALLEL_H
+#define _PARALLEL_H
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+
+inline unsigned defaultThreadCount() {
+    unsigned threads = std::thread::hardware_concurrency();
+    return threads == 0 ? 1 : threads;
+}
+
+// Runs body(begin, end) over [0, count) in chunks of `grain` items. Chunks
+// are claimed through a shared atomic cursor, so a thread that lands on
+// cheap chunks keeps taking more instead of idling behind a slow one.
+// Chunk k always covers [k * grain, (k + 1) * grain), which lets callers
+// keep one output buffer per chunk and stitch them together in order.
+template <typename Body>
+void parallelFor(size_t count, size_t grain, unsigned threads, Body body) {
+    if (grain == 0) {
+        grain = 1;
+    }
+    size_t chunks = (count + grain - 1) / grain;
+    threads = std::max(1u, std::min<unsigned>(threads, chunks));
+
+    std::atomic<size_t> next_chunk(0);
+    auto worker = [&]() {
+        for (size_t chunk = next_chunk++; chunk < chunks; chunk = next_chunk++) {
+            size_t begin = chunk * grain;
+            body(begin, std::min(count, begin + grain));
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < threads; i++) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+}
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef _PHASE_TIMER_H
+#define _PHASE_TIMER_H
+
+#include <chrono>
+#include <string>
+#include "output_writer.h"
+
+
+// Accumulates wall time per program phase. Phases may be entered many
+// times (parsing and inserting alternate line by line), so each one keeps
+// a running total. A disabled timer never reads the clock.
+class PhaseTimer {
+public:
+    enum Phase {
+        PARSE,
+        INSERT,
+        QUERY,
+        REPORT,
+        OUTPUT,
+        PHASE_COUNT
+    };
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    bool enabled;
+    int current;
+    Clock::time_point since;
+    Clock::time_point created;
+    double totals[PHASE_COUNT];
+
+    void appendSeconds(std::string& out, double seconds) const {
+        long long micros = (long long)(seconds * 1e6 + 0.5);
+        appendInt(out, micros / 1000000);
+        out += '.';
+        std::string fraction;
+        appendInt(fraction, micros % 1000000);
+        out.append(6 - fraction.size(), '0');
+        out += fraction;
+    }
+
+public:
+    //================================================================
+    // Constructors and Destructors
+    //================================================================
+    PhaseTimer(bool enabled): enabled(enabled), current(-1) {
+        for (double& total : totals) {
+            total = 0;
+        }
+        if (enabled) {
+            created = Clock::now();
+        }
+    }
+
+    //================================================================
+    // Getters and Setters
+    //================================================================
+    bool isEnabled() const {
+        return enabled;
+    }
+
+    double seconds(Phase phase) const {
+        return totals[phase];
+    }
+
+    static const char* name(Phase phase) {
+        static const char* const names[PHASE_COUNT] = {"parse", "insert", "query", "report", "output"};
+        return names[phase];
+    }
+
+    //================================================================
+    // Public Methods
+    //================================================================
+    // Ends the running phase, if any, and starts `phase`.
+    void enter(Phase phase) {
+        if (!enabled || current == phase) {
+            return;
+        }
+        Clock::time_point now = Clock::now();
+        if (current >= 0) {
+            totals[current] += std::chrono::duration<double>(now - since).count();
+        }
+        current = phase;
+        since = now;
+    }
+
+    void stop() {
+        if (!enabled || current < 0) {
+            return;
+        }
+        totals[current] += std::chrono::duration<double>(Clock::now() - since).count();
+        current = -1;
+    }
+
+    // {"parse": 0.012345, ..., "total": 0.100000} in seconds
+    std::string json() const {
+        std::string out = "{";
+        for (int phase = 0; phase < PHASE_COUNT; phase++) {
+            out += '"';
+            out += name(Phase(phase));
+            out += "\": ";
+            appendSeconds(out, totals[phase]);
+            out += ", ";
+        }
+        out += "\"total\": ";
+        appendSeconds(out, enabled ? std::chrono::duration<double>(Clock::now() - created).count() : 0.0);
+        out += '}';
+        return out;
+    }
+};
+
+#endif
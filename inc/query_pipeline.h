@@ -0,0 +1,151 @@
+#ifndef _QUERY_PIPELINE_H
+#define _QUERY_PIPELINE_H
+
+#include <list>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "outline.h"
+#include "layer_stack.h"
+#include "command_reader.h"
+
+
+// Answers runs of P and A queries on background threads while the main
+// thread goes on editing the plane. Each run is submitted with a version
+// of the plane taken where the run ends (see BasicOutline::version()),
+// so its answers are those of its place in the input. Runs are answered
+// in any order and read back in submission order.
+template <typename Coord>
+class QueryPipeline {
+public:
+    typedef BasicOutline<Coord> Outline;
+
+    // Shorter runs are cheaper to answer in place than the pages a
+    // version makes the plane copy.
+    static const size_t MIN_RUN = 256;
+
+    struct Run
+    {
+        std::unique_ptr<Outline> version;
+        std::vector<Command> queries;
+        std::vector<QueryAnswer> answers;
+        size_t position;        // answers given in place before this run
+    };
+
+private:
+    std::list<Run> runs;
+    std::list<Run*> pending;
+    size_t in_flight;
+    size_t max_in_flight;
+    bool closing;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::condition_variable drained;
+    std::vector<std::thread> workers;
+
+    void work() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            ready.wait(lock, [this]() {
+                return closing || !pending.empty();
+            });
+            if (pending.empty()) {
+                return;
+            }
+            Run& run = *pending.front();
+            pending.pop_front();
+            lock.unlock();
+
+            run.answers.reserve(run.queries.size());
+            for (const Command& command : run.queries) {
+                run.answers.push_back(answer(*run.version, command));
+            }
+            // Lets the plane write to the pages in place again
+            run.version.reset();
+
+            lock.lock();
+            in_flight--;
+            drained.notify_all();
+        }
+    }
+
+public:
+    //================================================================
+    // Constructors and Destructors
+    //================================================================
+    // `threads` workers answer runs; at most two runs per worker wait at
+    // a time, so a slow backlog cannot pin an unbounded number of pages.
+    QueryPipeline(unsigned threads): in_flight(0), max_in_flight(2 * std::max(1u, threads)), closing(false) {
+        for (unsigned i = 0; i < std::max(1u, threads); i++) {
+            workers.emplace_back(&QueryPipeline::work, this);
+        }
+    }
+    ~QueryPipeline() {
+        finish();
+    }
+    QueryPipeline(const QueryPipeline&) = delete;
+    QueryPipeline& operator=(const QueryPipeline&) = delete;
+
+    //================================================================
+    // Getters and Setters
+    //================================================================
+    // Every run submitted so far; complete once finish() returned
+    const std::list<Run>& getRuns() const {
+        return runs;
+    }
+
+    //================================================================
+    // Public Methods
+    //================================================================
+    // The answer line of one P or A query
+    static QueryAnswer answer(Outline& outline, const Command& command) {
+        if (command.type == Command::POINT) {
+            TileIndex tile = outline.findTileatPoint(outline.narrow(command.point));
+            BasicPoint<Coord> corner = outline.getTile(tile).getRect().bottom_left;
+            return {corner.x, corner.y};
+        }
+        QueryAnswer counts = {0, 0};
+        outline.enumerateArea(outline.narrow(command.rect), [&](TileIndex tile) {
+            if (outline.getTile(tile).isTile()) {
+                counts.first++;
+            } else {
+                counts.second++;
+            }
+        });
+        return counts;
+    }
+
+    // Queues `queries` to be answered on a version of `outline` as it is
+    // now. Waits while too many runs are in flight.
+    void submit(Outline& outline, std::vector<Command>& queries, size_t position) {
+        std::unique_lock<std::mutex> lock(mutex);
+        drained.wait(lock, [this]() {
+            return in_flight < max_in_flight;
+        });
+        runs.emplace_back();
+        Run& run = runs.back();
+        run.version = outline.version();
+        run.queries.swap(queries);
+        run.position = position;
+        pending.push_back(&run);
+        in_flight++;
+        ready.notify_one();
+    }
+
+    // Answers every run still queued and stops the workers
+    void finish() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closing = true;
+        }
+        ready.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        workers.clear();
+    }
+};
+
+#endif
@@ -0,0 +1,282 @@
+#ifndef _RASTERIZER_H
+#define _RASTERIZER_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include "outline.h"
+#include "parallel.h"
+#include "output_writer.h"
+
+
+// RGB image written as binary PPM or as PNG. The PNG encoder stores the
+// scanlines in uncompressed deflate blocks, so it needs no zlib.
+class Image {
+private:
+    int width;
+    int height;
+    std::vector<uint8_t> pixels;
+
+    static uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+        static uint32_t table[256];
+        static bool ready = false;
+        if (!ready) {
+            for (uint32_t n = 0; n < 256; n++) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++) {
+                    c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                table[n] = c;
+            }
+            ready = true;
+        }
+        crc = ~crc;
+        for (size_t i = 0; i < size; i++) {
+            crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    static void appendBigEndian(std::string& out, uint32_t value) {
+        out += char(value >> 24);
+        out += char(value >> 16);
+        out += char(value >> 8);
+        out += char(value);
+    }
+
+    static void appendChunk(std::string& out, const char* type, const std::string& data) {
+        appendBigEndian(out, data.size());
+        std::string body = std::string(type, 4) + data;
+        out += body;
+        appendBigEndian(out, crc32(reinterpret_cast<const uint8_t*>(body.data()), body.size()));
+    }
+
+public:
+    //================================================================
+    // Constructors and Destructors
+    //================================================================
+    Image(int width, int height): width(width), height(height), pixels(size_t(width) * height * 3, 0) {}
+
+    //================================================================
+    // Getters and Setters
+    //================================================================
+    int getWidth() const {
+        return width;
+    }
+
+    int getHeight() const {
+        return height;
+    }
+
+    uint8_t* row(int y) {
+        return pixels.data() + size_t(y) * width * 3;
+    }
+
+    //================================================================
+    // Public Methods
+    //================================================================
+    bool writePPM(const std::string& path) const {
+        OutputWriter output;
+        if (!output.open(path, false)) {
+            return false;
+        }
+        output.write("P6\n").write(width).write(' ').write(height).write("\n255\n");
+        output.write(std::string(reinterpret_cast<const char*>(pixels.data()), pixels.size()));
+        return output.close();
+    }
+
+    bool writePNG(const std::string& path) const {
+        std::string png("\x89PNG\r\n\x1a\n", 8);
+        std::string header;
+        appendBigEndian(header, width);
+        appendBigEndian(header, height);
+        header += std::string("\x08\x02\x00\x00\x00", 5);   // 8-bit RGB, no interlace
+        appendChunk(png, "IHDR", header);
+
+        // zlib stream of stored blocks; every scanline starts with filter 0
+        std::string scanlines;
+        scanlines.reserve(size_t(height) * (size_t(width) * 3 + 1));
+        for (int y = 0; y < height; y++) {
+            scanlines += '\0';
+            scanlines.append(reinterpret_cast<const char*>(pixels.data()) + size_t(y) * width * 3, size_t(width) * 3);
+        }
+        std::string zlib("\x78\x01", 2);
+        size_t done = 0;
+        do {
+            size_t size = std::min<size_t>(scanlines.size() - done, 65535);
+            zlib += char(done + size == scanlines.size() ? 1 : 0);
+            zlib += char(size & 0xFF);
+            zlib += char(size >> 8);
+            zlib += char(~size & 0xFF);
+            zlib += char((~size >> 8) & 0xFF);
+            zlib.append(scanlines, done, size);
+            done += size;
+        } while (done < scanlines.size());
+        uint32_t a = 1;
+        uint32_t b = 0;
+        for (unsigned char c : scanlines) {
+            a = (a + c) % 65521;
+            b = (b + a) % 65521;
+        }
+        appendBigEndian(zlib, (b << 16) | a);
+        appendChunk(png, "IDAT", zlib);
+        appendChunk(png, "IEND", std::string());
+
+        OutputWriter output;
+        return output.open(path, false) && output.write(png).close();
+    }
+};
+
+// Draws a window of an Outline into an Image with the colors of
+// draw_block_layout.py: blocks #FCC, space #BBB, tile edges black.
+//
+// Every pixel is shaded by the fraction of it covered by blocks, so tiles
+// smaller than a pixel still show up as coverage instead of vanishing or
+// being drawn one patch each. Edges are only drawn for tiles at least
+// EDGE_MIN pixels wide and high; below that they would paint the whole
+// area black. The tiles in the window are collected once and bucketed by
+// image stripe, then the stripes are rasterized in parallel.
+template <typename Coord>
+class Rasterizer {
+private:
+    static const int STRIPE_ROWS = 64;
+    static constexpr double EDGE_MIN = 2.0;
+
+    struct PixelRect
+    {
+        double left;
+        double right;
+        double top;         // image rows grow downwards
+        double bottom;
+        bool edge[4];       // left, right, top, bottom edge inside the window
+    };
+
+    BasicOutline<Coord>& outline;
+    BasicRect<long long> window;
+
+    PixelRect toPixels(BasicRect<Coord> rect, const Image& image) const {
+        double scale_x = double(image.getWidth()) / double(window.top_right.x - window.bottom_left.x);
+        double scale_y = double(image.getHeight()) / double(window.top_right.y - window.bottom_left.y);
+        long long left = std::max<long long>(rect.bottom_left.x, window.bottom_left.x);
+        long long right = std::min<long long>(rect.top_right.x, window.top_right.x);
+        long long bottom = std::max<long long>(rect.bottom_left.y, window.bottom_left.y);
+        long long top = std::min<long long>(rect.top_right.y, window.top_right.y);
+        PixelRect pixels;
+        pixels.left = double(left - window.bottom_left.x) * scale_x;
+        pixels.right = double(right - window.bottom_left.x) * scale_x;
+        pixels.top = double(window.top_right.y - top) * scale_y;
+        pixels.bottom = double(window.top_right.y - bottom) * scale_y;
+        pixels.edge[0] = rect.bottom_left.x >= window.bottom_left.x;
+        pixels.edge[1] = rect.top_right.x <= window.top_right.x;
+        pixels.edge[2] = rect.top_right.y <= window.top_right.y;
+        pixels.edge[3] = rect.bottom_left.y >= window.bottom_left.y;
+        return pixels;
+    }
+
+    static bool hasEdges(const PixelRect& pixels) {
+        return pixels.right - pixels.left >= EDGE_MIN && pixels.bottom - pixels.top >= EDGE_MIN;
+    }
+
+    // Adds the block area of `pixels` to the coverage of rows [first, last)
+    static void cover(const PixelRect& pixels, int first, int last, int width, std::vector<float>& coverage) {
+        int row_begin = std::max(first, int(pixels.top));
+        int row_end = std::min(last, int(std::ceil(pixels.bottom)));
+        int column_begin = int(pixels.left);
+        int column_end = std::min(width, int(std::ceil(pixels.right)));
+        for (int y = row_begin; y < row_end; y++) {
+            double height = std::min(pixels.bottom, y + 1.0) - std::max(pixels.top, double(y));
+            float* line = coverage.data() + size_t(y - first) * width;
+            for (int x = column_begin; x < column_end; x++) {
+                line[x] += float(height * (std::min(pixels.right, x + 1.0) - std::max(pixels.left, double(x))));
+            }
+        }
+    }
+
+    static void outlineEdges(const PixelRect& pixels, int first, int last, int width, int height, std::vector<uint8_t>& edges) {
+        int left = int(pixels.left);
+        int right = std::min(width - 1, int(pixels.right));
+        int top = int(pixels.top);
+        int bottom = std::min(height - 1, int(pixels.bottom));
+        for (int y = std::max(first, top); y <= bottom && y < last; y++) {
+            uint8_t* line = edges.data() + size_t(y - first) * width;
+            if (pixels.edge[0]) {
+                line[left] = 1;
+            }
+            if (pixels.edge[1]) {
+                line[right] = 1;
+            }
+            if ((pixels.edge[2] && y == top) || (pixels.edge[3] && y == bottom)) {
+                std::fill(line + left, line + right + 1, 1);
+            }
+        }
+    }
+
+public:
+    //================================================================
+    // Constructors and Destructors
+    //================================================================
+    // `window` must lie inside the outline and have a positive area
+    Rasterizer(BasicOutline<Coord>& outline, BasicRect<long long> window): outline(outline), window(window) {}
+
+    //================================================================
+    // Public Methods
+    //================================================================
+    void render(Image& image, unsigned threads) {
+        int width = image.getWidth();
+        int height = image.getHeight();
+        int stripes = (height + STRIPE_ROWS - 1) / STRIPE_ROWS;
+
+        // Tiles that draw something, bucketed by the stripes they touch
+        std::vector<std::vector<TileIndex>> buckets(stripes);
+        outline.enumerateArea(outline.narrow(window), [&](TileIndex tile) {
+            PixelRect pixels = toPixels(outline.getTile(tile).getRect(), image);
+            if (!outline.getTile(tile).isTile() && !hasEdges(pixels)) {
+                return;
+            }
+            int first = std::max(0, int(pixels.top) / STRIPE_ROWS);
+            int last = std::min(stripes - 1, int(pixels.bottom) / STRIPE_ROWS);
+            for (int stripe = first; stripe <= last; stripe++) {
+                buckets[stripe].push_back(tile);
+            }
+        });
+
+        parallelFor(stripes, 1, threads, [&](size_t begin, size_t end) {
+            std::vector<float> coverage;
+            std::vector<uint8_t> edges;
+            for (size_t stripe = begin; stripe < end; stripe++) {
+                int first = int(stripe) * STRIPE_ROWS;
+                int last = std::min(height, first + STRIPE_ROWS);
+                coverage.assign(size_t(last - first) * width, 0.0f);
+                edges.assign(size_t(last - first) * width, 0);
+                for (TileIndex tile : buckets[stripe]) {
+                    PixelRect pixels = toPixels(outline.getTile(tile).getRect(), image);
+                    if (outline.getTile(tile).isTile()) {
+                        cover(pixels, first, last, width, coverage);
+                    }
+                    if (hasEdges(pixels)) {
+                        outlineEdges(pixels, first, last, width, height, edges);
+                    }
+                }
+                for (int y = first; y < last; y++) {
+                    uint8_t* pixel = image.row(y);
+                    const float* line = coverage.data() + size_t(y - first) * width;
+                    const uint8_t* edge = edges.data() + size_t(y - first) * width;
+                    for (int x = 0; x < width; x++, pixel += 3) {
+                        if (edge[x]) {
+                            pixel[0] = pixel[1] = pixel[2] = 0;
+                            continue;
+                        }
+                        float solid = std::min(1.0f, line[x]);
+                        pixel[0] = uint8_t(0xBB + solid * (0xFF - 0xBB) + 0.5f);
+                        pixel[1] = uint8_t(0xBB + solid * (0xCC - 0xBB) + 0.5f);
+                        pixel[2] = uint8_t(0xBB + solid * (0xCC - 0xBB) + 0.5f);
+                    }
+                }
+            }
+        });
+    }
+};
+
+#endif
@@ -0,0 +1,507 @@
+#ifndef _SERVER_H
+#define _SERVER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <csignal>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "outline.h"
+#include "parallel.h"
+#include "command_reader.h"
+#include "output_writer.h"
+
+
+// Set by SIGINT/SIGTERM to stop a socket server between poll rounds
+static volatile sig_atomic_t server_stop_requested = 0;
+
+inline void requestServerStop(int) {
+    server_stop_requested = 1;
+}
+
+// Keeps one Outline resident and answers requests from clients on a Unix
+// domain socket, or from stdin on stdout. Requests are lines in the input
+// format, one reply line each:
+//   id x y w h     insert a block             -> "ok"
+//   D id           delete a block             -> "ok"
+//   P x y          point query                -> "x y" of the tile corner
+//   A x y w h      area query                 -> "solid space"
+//   N id           neighbor counts of a block -> "solid space"
+//   O x y          nearest obstacles          -> "id gap" above, right,
+//                                                below and left of the
+//                                                point; id 0 is the edge
+//   G id           nearest obstacles of a block, as for O
+//   S d            spacing check              -> "pairs", then one
+//                                                "id id gap" per pair of
+//                                                blocks closer than d
+//   R              full report                -> "tiles blocks", then one
+//                                                "id solid space" per block
+//   Q              close this connection (stdin: stop the server)
+// A failed request answers "error: <message>" and changes nothing.
+//
+// Every poll round reads whatever the ready clients sent and serves the
+// complete lines in arrival order. Reads between two writes are answered
+// as one batch; once a run of reads is as long as the plane is large the
+// plane is frozen, and the P queries of a frozen batch are answered in
+// parallel from the read-only index. Socket clients are non-blocking, so
+// a client that does not read its replies only stalls itself.
+template <typename Coord>
+class Server {
+private:
+    typedef BasicOutline<Coord> Outline;
+
+    // A client with this much unsent output is not read from until it
+    // has taken some of its replies.
+    static const size_t OUTPUT_LIMIT = size_t(1) << 20;
+
+    struct Client
+    {
+        int in_fd;
+        int out_fd;
+        std::string input;
+        std::string output;
+        size_t line_number;
+        bool closing;
+    };
+
+    struct Request
+    {
+        Client* client;
+        Command command;
+        char op;                // 'N', 'O', 'G', 'S', 'R', 'Q' or 0 for a parsed Command
+        std::string error;
+        std::string reply;
+    };
+
+    Outline& outline;
+    unsigned threads;
+    bool use_freeze;
+    int listen_fd;
+    std::string socket_path;
+    std::vector<std::unique_ptr<Client>> clients;
+    CommandReader parser;
+    size_t query_run;
+    std::string error_message;
+
+    static bool isRead(const Request& request) {
+        return (request.op != 0 && request.op != 'Q')
+            || (request.op == 0 && (request.command.type == Command::POINT || request.command.type == Command::AREA));
+    }
+
+    void closeClient(Client& client) {
+        if (client.in_fd > 0) {
+            ::close(client.in_fd);
+        }
+        client.in_fd = -1;
+    }
+
+    // Splits a client's input into requests; a partial last line waits
+    // for the next round.
+    void takeRequests(Client& client, std::vector<Request>& requests) {
+        size_t begin = 0;
+        for (;;) {
+            size_t newline = client.input.find('\n', begin);
+            if (newline == std::string::npos) {
+                break;
+            }
+            const char* it = client.input.data() + begin;
+            const char* line_end = client.input.data() + newline;
+            begin = newline + 1;
+            client.line_number++;
+            while (it < line_end && (*it == ' ' || *it == '\t' || *it == '\r')) {
+                it++;
+            }
+            if (it == line_end) {
+                continue;
+            }
+
+            Request request;
+            request.client = &client;
+            request.op = 0;
+            if (*it == 'N' || *it == 'O' || *it == 'G' || *it == 'S' || *it == 'R' || *it == 'Q') {
+                request.op = *it;
+                const char* rest = it + 1;
+                if (request.op == 'N' || request.op == 'G' || request.op == 'S' || request.op == 'O') {
+                    // Reuse the D parser for the id or distance, and the P
+                    // parser for the point
+                    std::string line = (request.op == 'O' ? "P" : "D") + std::string(rest, line_end);
+                    if (!parser.parseLine(line.data(), line.data() + line.size(), client.line_number, request.command)) {
+                        request.error = parser.error();
+                    } else
+                    if (request.op == 'S' && request.command.id <= 0) {
+                        request.error = "line " + std::to_string(client.line_number) + ": the spacing must be positive";
+                    }
+                } else {
+                    while (rest < line_end && (*rest == ' ' || *rest == '\t' || *rest == '\r')) {
+                        rest++;
+                    }
+                    if (rest != line_end) {
+                        request.error = "line " + std::to_string(client.line_number) + ": unexpected trailing characters";
+                    }
+                }
+            } else
+            if (!parser.parseLine(it, line_end, client.line_number, request.command)) {
+                request.error = parser.error();
+            } else
+            if (request.command.type == Command::LAYER || request.command.type == Command::CROSS) {
+                request.error = "line " + std::to_string(client.line_number) + ": layer commands need --layers";
+            }
+            requests.push_back(request);
+            if (request.op == 'Q' && request.error.empty()) {
+                client.closing = true;
+                break;
+            }
+        }
+        client.input.erase(0, begin);
+    }
+
+    void answerPoint(Request& request) {
+        TileIndex tile = outline.findTileatPoint(outline.narrow(request.command.point));
+        if (tile == NIL_TILE) {
+            request.reply = "error: point outside the outline\n";
+            return;
+        }
+        BasicPoint<Coord> corner = outline.getTile(tile).getRect().bottom_left;
+        appendInt(request.reply, corner.x);
+        request.reply += ' ';
+        appendInt(request.reply, corner.y);
+        request.reply += '\n';
+    }
+
+    // "id gap" on all four sides; the outline edge has id 0
+    void appendObstacles(Request& request, TileIndex block, BasicPoint<Coord> point) {
+        for (Side side : {ABOVE, RIGHT, BELOW, LEFT}) {
+            Obstacle obstacle = block == NIL_TILE ? outline.nearestObstacle(point, side) : outline.nearestObstacle(block, side);
+            appendInt(request.reply, obstacle.tile == NIL_TILE ? 0 : outline.getTile(obstacle.tile).getId());
+            request.reply += ' ';
+            appendInt(request.reply, obstacle.distance);
+            request.reply += side == LEFT ? '\n' : ' ';
+        }
+    }
+
+    void answerRead(Request& request) {
+        if (request.op == 'O') {
+            BasicPoint<Coord> point = outline.narrow(request.command.point);
+            if (outline.findTileatPoint(point) == NIL_TILE) {
+                request.reply = "error: point outside the outline\n";
+                return;
+            }
+            appendObstacles(request, NIL_TILE, point);
+        } else
+        if (request.op == 'G') {
+            TileIndex block = outline.findBlock(request.command.id);
+            if (block == NIL_TILE) {
+                request.reply = "error: no block with id " + std::to_string(request.command.id) + "\n";
+                return;
+            }
+            appendObstacles(request, block, {0, 0});
+        } else
+        if (request.op == 'S') {
+            std::string pairs;
+            size_t count = 0;
+            outline.forEachClosePair(request.command.id, [&](TileIndex block, TileIndex other, long long gap) {
+                appendInt(pairs, outline.getTile(block).getId());
+                pairs += ' ';
+                appendInt(pairs, outline.getTile(other).getId());
+                pairs += ' ';
+                appendInt(pairs, gap);
+                pairs += '\n';
+                count++;
+            });
+            appendInt(request.reply, count);
+            request.reply += '\n';
+            request.reply += pairs;
+        } else
+        if (request.op == 'N') {
+            TileIndex block = outline.findBlock(request.command.id);
+            if (block == NIL_TILE) {
+                request.reply = "error: no block with id " + std::to_string(request.command.id) + "\n";
+                return;
+            }
+            NeighborCount count = outline.neighborCount(block);
+            appendInt(request.reply, count.solid_count);
+            request.reply += ' ';
+            appendInt(request.reply, count.space_count);
+            request.reply += '\n';
+        } else
+        if (request.op == 'R') {
+            appendInt(request.reply, outline.blocks.size());
+            request.reply += ' ';
+            appendInt(request.reply, outline.block_ids.size());
+            request.reply += '\n';
+            for (const std::pair<const int, TileIndex>& block : outline.block_ids) {
+                NeighborCount count = outline.neighborCount(block.second);
+                appendInt(request.reply, block.first);
+                request.reply += ' ';
+                appendInt(request.reply, count.solid_count);
+                request.reply += ' ';
+                appendInt(request.reply, count.space_count);
+                request.reply += '\n';
+            }
+        } else
+        if (request.command.type == Command::POINT) {
+            answerPoint(request);
+        } else {
+            int solid = 0;
+            int space = 0;
+            outline.enumerateArea(outline.narrow(request.command.rect), [&](TileIndex tile) {
+                if (outline.getTile(tile).isTile()) {
+                    solid++;
+                } else {
+                    space++;
+                }
+            });
+            appendInt(request.reply, solid);
+            request.reply += ' ';
+            appendInt(request.reply, space);
+            request.reply += '\n';
+        }
+    }
+
+    // Answers requests [begin, end), all reads. The frozen index is the
+    // only read path that is safe to share between threads, so only a
+    // frozen batch of P queries runs in parallel.
+    void answerBatch(std::vector<Request>& requests, size_t begin, size_t end) {
+        query_run += end - begin;
+        if (use_freeze && !outline.isFrozen() && query_run >= outline.blocks.size()) {
+            outline.freeze();
+        }
+        if (outline.isFrozen()) {
+            parallelFor(end - begin, 1024, threads, [&](size_t first, size_t last) {
+                for (size_t i = begin + first; i < begin + last; i++) {
+                    if (requests[i].error.empty() && requests[i].op == 0 && requests[i].command.type == Command::POINT) {
+                        answerPoint(requests[i]);
+                    }
+                }
+            });
+        }
+        for (size_t i = begin; i < end; i++) {
+            if (requests[i].error.empty() && requests[i].reply.empty()) {
+                answerRead(requests[i]);
+            }
+        }
+    }
+
+    // A batch input is trusted, but one bad request must not corrupt the
+    // resident plane. Ids are checked before this: id 0 marks a free tile
+    // and negative ids are space.
+    bool fitsInSpace(BasicRect<long long> rect) {
+        if (rect.bottom_left.x < 0 || rect.bottom_left.y < 0 || rect.top_right.x > outline.getWidth() || rect.top_right.y > outline.getHeight()
+            || rect.bottom_left.x >= rect.top_right.x || rect.bottom_left.y >= rect.top_right.y) {
+            return false;
+        }
+        bool overlaps = false;
+        outline.enumerateArea(outline.narrow(rect), [&](TileIndex tile) {
+            overlaps = overlaps || outline.getTile(tile).isTile();
+        });
+        return !overlaps;
+    }
+
+    void answerWrite(Request& request) {
+        query_run = 0;
+        if (request.op == 'Q') {
+            request.reply = "ok\n";
+        } else
+        if (request.command.type == Command::DELETE) {
+            request.reply = outline.deleteBlock(request.command.id)
+                ? "ok\n" : "error: no block with id " + std::to_string(request.command.id) + "\n";
+        } else
+        if (request.command.id <= 0) {
+            request.reply = "error: block id " + std::to_string(request.command.id) + " is not positive\n";
+        } else
+        if (outline.findBlock(request.command.id) != NIL_TILE) {
+            request.reply = "error: block " + std::to_string(request.command.id) + " already exists\n";
+        } else
+        if (!fitsInSpace(request.command.rect)) {
+            request.reply = "error: block " + std::to_string(request.command.id) + " is empty, leaves the outline or overlaps a block\n";
+        } else {
+            outline.createBlock(outline.narrow(request.command.rect), request.command.id);
+            request.reply = "ok\n";
+        }
+    }
+
+    void serve(std::vector<Request>& requests) {
+        size_t batch = 0;
+        for (size_t i = 0; i <= requests.size(); i++) {
+            if (i < requests.size() && (isRead(requests[i]) || !requests[i].error.empty())) {
+                continue;
+            }
+            answerBatch(requests, batch, i);
+            if (i < requests.size()) {
+                answerWrite(requests[i]);
+            }
+            batch = i + 1;
+        }
+        for (Request& request : requests) {
+            Client& client = *request.client;
+            client.output += request.error.empty() ? request.reply : "error: " + request.error + "\n";
+        }
+    }
+
+    // Writes as much pending output as the client takes; false when the
+    // connection failed.
+    bool flush(Client& client) {
+        size_t done = 0;
+        while (done < client.output.size()) {
+            ssize_t wrote = ::write(client.out_fd, client.output.data() + done, client.output.size() - done);
+            if (wrote < 0 && errno == EINTR) {
+                continue;
+            }
+            if (wrote < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            }
+            if (wrote <= 0) {
+                return false;
+            }
+            done += wrote;
+        }
+        client.output.erase(0, done);
+        return true;
+    }
+
+public:
+    //================================================================
+    // Constructors and Destructors
+    //================================================================
+    Server(Outline& outline, unsigned threads, bool use_freeze)
+        : outline(outline), threads(threads), use_freeze(use_freeze), listen_fd(-1), query_run(0) {}
+    ~Server() {
+        for (std::unique_ptr<Client>& client : clients) {
+            closeClient(*client);
+        }
+        if (listen_fd >= 0) {
+            ::close(listen_fd);
+            unlink(socket_path.c_str());
+        }
+    }
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    //================================================================
+    // Getters and Setters
+    //================================================================
+    const std::string& error() const {
+        return error_message;
+    }
+
+    //================================================================
+    // Public Methods
+    //================================================================
+    // "-" serves stdin and stdout; anything else is the path of a Unix
+    // domain socket to create.
+    bool open(const std::string& path) {
+        if (path == "-") {
+            clients.emplace_back(new Client{0, 1, std::string(), std::string(), 0, false});
+            return true;
+        }
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path)) {
+            error_message = "socket path too long: " + path;
+            return false;
+        }
+        std::strcpy(address.sun_path, path.c_str());
+        listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0 || bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+            || listen(listen_fd, 64) != 0) {
+            error_message = "unable to listen on " + path + ": " + std::strerror(errno);
+            if (listen_fd >= 0) {
+                ::close(listen_fd);
+                listen_fd = -1;
+            }
+            return false;
+        }
+        socket_path = path;
+        signal(SIGINT, requestServerStop);
+        signal(SIGTERM, requestServerStop);
+        signal(SIGPIPE, SIG_IGN);
+        return true;
+    }
+
+    // Serves until stdin ends, a stdin client sends Q, or a socket server
+    // is interrupted.
+    void run() {
+        std::vector<pollfd> fds;
+        std::vector<char> chunk(size_t(1) << 16);
+        while (!server_stop_requested) {
+            fds.clear();
+            if (listen_fd >= 0) {
+                fds.push_back({listen_fd, POLLIN, 0});
+            }
+            for (std::unique_ptr<Client>& client : clients) {
+                short events = !client->closing && client->output.size() < OUTPUT_LIMIT ? POLLIN : 0;
+                if (!client->output.empty()) {
+                    events |= POLLOUT;
+                }
+                fds.push_back({client->in_fd, events, 0});
+            }
+            if (fds.empty()) {
+                return;
+            }
+            if (poll(fds.data(), fds.size(), -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                error_message = std::string("poll failed: ") + std::strerror(errno);
+                return;
+            }
+
+            std::vector<Request> requests;
+            size_t first_client = 0;
+            if (listen_fd >= 0) {
+                first_client = 1;
+                if (fds[0].revents & POLLIN) {
+                    int fd = accept(listen_fd, nullptr, nullptr);
+                    if (fd >= 0) {
+                        fcntl(fd, F_SETFL, O_NONBLOCK);
+                        clients.emplace_back(new Client{fd, fd, std::string(), std::string(), 0, false});
+                    }
+                }
+            }
+            for (size_t i = first_client; i < fds.size(); i++) {
+                Client& client = *clients[i - first_client];
+                if (client.closing || (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) == 0) {
+                    continue;
+                }
+                ssize_t got = ::read(client.in_fd, chunk.data(), chunk.size());
+                if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+                    continue;
+                }
+                if (got <= 0) {
+                    client.closing = true;
+                    if (!client.input.empty()) {
+                        client.input += '\n';
+                    }
+                } else {
+                    client.input.append(chunk.data(), got);
+                }
+                takeRequests(client, requests);
+            }
+            serve(requests);
+
+            bool stdin_done = false;
+            for (size_t i = 0; i < clients.size();) {
+                Client& client = *clients[i];
+                if (!flush(client) || (client.closing && client.output.empty())) {
+                    stdin_done = stdin_done || client.in_fd == 0;
+                    closeClient(client);
+                    clients.erase(clients.begin() + i);
+                } else {
+                    i++;
+                }
+            }
+            if (stdin_done) {
+                return;
+            }
+        }
+    }
+};
+
+#endif
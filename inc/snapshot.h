@@ -0,0 +1,167 @@
+#ifndef _SNAPSHOT_H
+#define _SNAPSHOT_H
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tile.h"
+
+
+// Binary snapshot of a tile plane. The file is a header, the tiles as
+// fixed-size records and the (id, tile) pairs of every block sorted by
+// id. Stitches are stored as record numbers, so a snapshot needs no
+// pointer fix-up and the records can be read straight from the mapping.
+// Fields are in host byte order; byte_order tells a reader on a machine
+// of the other endianness that the file is not for it.
+const char SNAPSHOT_MAGIC[8] = {'L', 'A', 'B', '1', 'S', 'N', 'A', 'P'};
+const uint32_t SNAPSHOT_VERSION = 1;
+const uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    int32_t width;
+    int32_t height;
+    uint32_t tile_count;
+    uint32_t block_count;
+    uint32_t start;
+    uint32_t reserved;
+};
+
+struct SnapshotTile
+{
+    int32_t left;
+    int32_t bottom;
+    int32_t right;
+    int32_t top;
+    int32_t id;
+    uint32_t above_stitch;
+    uint32_t right_stitch;
+    uint32_t below_stitch;
+    uint32_t left_stitch;
+};
+
+struct SnapshotBlock
+{
+    int32_t id;
+    uint32_t tile;
+};
+
+// Read-only mapping of a snapshot file. open() checks the header and
+// that every stitch and block entry points at a record in the file, so
+// Outline::loadSnapshot can trust the contents.
+class SnapshotFile {
+private:
+    int fd;
+    const char* map_begin;
+    size_t map_size;
+    const SnapshotHeader* header;
+    std::string error_message;
+
+    bool fail(const std::string& message) {
+        error_message = message;
+        return false;
+    }
+
+    static bool validStitch(uint32_t stitch, uint32_t count) {
+        return stitch == NIL_TILE || stitch < count;
+    }
+
+public:
+    //================================================================
+    // Constructors and Destructors
+    //================================================================
+    SnapshotFile(): fd(-1), map_begin(nullptr), map_size(0), header(nullptr) {}
+    ~SnapshotFile() {
+        if (map_begin != nullptr) {
+            munmap(const_cast<char*>(map_begin), map_size);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+    SnapshotFile(const SnapshotFile&) = delete;
+    SnapshotFile& operator=(const SnapshotFile&) = delete;
+
+    //================================================================
+    // Getters and Setters
+    //================================================================
+    const std::string& error() const {
+        return error_message;
+    }
+
+    const SnapshotHeader& getHeader() const {
+        return *header;
+    }
+
+    const SnapshotTile* tiles() const {
+        return reinterpret_cast<const SnapshotTile*>(map_begin + sizeof(SnapshotHeader));
+    }
+
+    const SnapshotBlock* blocks() const {
+        return reinterpret_cast<const SnapshotBlock*>(tiles() + header->tile_count);
+    }
+
+    //================================================================
+    // Public Methods
+    //================================================================
+    bool open(const std::string& path) {
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return fail("unable to open snapshot " + path);
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(SnapshotHeader)) {
+            return fail(path + ": not a snapshot");
+        }
+        void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            return fail("unable to map snapshot " + path);
+        }
+        map_begin = static_cast<const char*>(map);
+        map_size = st.st_size;
+        header = reinterpret_cast<const SnapshotHeader*>(map_begin);
+
+        if (std::memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+            return fail(path + ": not a snapshot");
+        }
+        if (header->byte_order != SNAPSHOT_BYTE_ORDER) {
+            return fail(path + ": snapshot was written with a different byte order");
+        }
+        if (header->version != SNAPSHOT_VERSION) {
+            return fail(path + ": unsupported snapshot version " + std::to_string(header->version));
+        }
+        uint64_t expected = sizeof(SnapshotHeader) + uint64_t(header->tile_count) * sizeof(SnapshotTile)
+            + uint64_t(header->block_count) * sizeof(SnapshotBlock);
+        if (expected != map_size) {
+            return fail(path + ": snapshot is truncated or has trailing data");
+        }
+        if (header->width <= 0 || header->height <= 0 || header->start >= header->tile_count) {
+            return fail(path + ": corrupt snapshot header");
+        }
+
+        uint32_t count = header->tile_count;
+        const SnapshotTile* tile = tiles();
+        for (uint32_t i = 0; i < count; i++, tile++) {
+            if (!validStitch(tile->above_stitch, count) || !validStitch(tile->right_stitch, count)
+                || !validStitch(tile->below_stitch, count) || !validStitch(tile->left_stitch, count)) {
+                return fail(path + ": corrupt stitch in tile " + std::to_string(i));
+            }
+        }
+        const SnapshotBlock* block = blocks();
+        for (uint32_t i = 0; i < header->block_count; i++, block++) {
+            if (block->tile >= count || (i > 0 && block[-1].id >= block->id)) {
+                return fail(path + ": corrupt block table");
+            }
+        }
+        return true;
+    }
+};
+
+#endif
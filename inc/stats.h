@@ -0,0 +1,133 @@
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <string>
+#include <atomic>
+#include <cstddef>
+#include "output_writer.h"
+
+
+// Hot-path counters are compiled in only with -DLAB1_STATS (make STATS=1).
+// In a normal build STATS(...) expands to nothing, so the counting code
+// costs neither time nor a branch.
+#ifdef LAB1_STATS
+#define STATS(statement) statement
+const bool STATS_ENABLED = true;
+#else
+#define STATS(statement)
+const bool STATS_ENABLED = false;
+#endif
+
+
+// Histogram over power-of-two buckets: bucket 0 holds 0, bucket b holds
+// [2^(b-1), 2^b).
+class Histogram {
+private:
+    static const int BUCKETS = 65;
+
+    unsigned long long counts[BUCKETS];
+    unsigned long long count;
+    unsigned long long sum;
+    unsigned long long max;
+
+public:
+    Histogram(): count(0), sum(0), max(0) {
+        for (unsigned long long& bucket : counts) {
+            bucket = 0;
+        }
+    }
+
+    void add(unsigned long long value) {
+        int bucket = 0;
+        while (bucket < 64 && (value >> bucket) != 0) {
+            bucket++;
+        }
+        counts[bucket]++;
+        count++;
+        sum += value;
+        if (value > max) {
+            max = value;
+        }
+    }
+
+    // {"count": n, "sum": s, "max": m, "buckets": [[low, n], ...]} with
+    // only the non-empty buckets, keyed by their lowest value
+    std::string json() const {
+        std::string out = "{\"count\": ";
+        appendInt(out, count);
+        out += ", \"sum\": ";
+        appendInt(out, sum);
+        out += ", \"max\": ";
+        appendInt(out, max);
+        out += ", \"buckets\": [";
+        bool first = true;
+        for (int bucket = 0; bucket < BUCKETS; bucket++) {
+            if (counts[bucket] == 0) {
+                continue;
+            }
+            out += first ? "[" : ", [";
+            appendInt(out, bucket == 0 ? 0 : 1ULL << (bucket - 1));
+            out += ", ";
+            appendInt(out, counts[bucket]);
+            out += ']';
+            first = false;
+        }
+        out += "]}";
+        return out;
+    }
+};
+
+// Counters kept by an Outline. neighborFinding runs on several threads,
+// so its counters are atomics updated once per call.
+struct OutlineStats
+{
+    Histogram walk_steps;           // stitch steps per findTileatPoint walk
+    Histogram create_splits;        // tile splits per createBlock
+    Histogram create_merges;        // tile merges per createBlock
+    Histogram create_allocations;   // tiles allocated per createBlock
+    Histogram create_releases;      // tiles released per createBlock
+    unsigned long long splits;
+    unsigned long long merges;
+    unsigned long long transfers;   // strips moved from one tile to another
+    unsigned long long allocations;
+    unsigned long long releases;
+    std::atomic<unsigned long long> neighbor_calls;
+    std::atomic<unsigned long long> neighbor_tiles;
+    size_t peak_live_tiles;
+
+    OutlineStats(): splits(0), merges(0), transfers(0), allocations(0), releases(0), neighbor_calls(0), neighbor_tiles(0), peak_live_tiles(0) {}
+
+    void notePeak(size_t live_tiles) {
+        if (live_tiles > peak_live_tiles) {
+            peak_live_tiles = live_tiles;
+        }
+    }
+
+    std::string json() const {
+        std::string out = "{\"walk_steps\": " + walk_steps.json();
+        out += ", \"create_splits\": " + create_splits.json();
+        out += ", \"create_merges\": " + create_merges.json();
+        out += ", \"create_allocations\": " + create_allocations.json();
+        out += ", \"create_releases\": " + create_releases.json();
+        out += ", \"splits\": ";
+        appendInt(out, splits);
+        out += ", \"merges\": ";
+        appendInt(out, merges);
+        out += ", \"transfers\": ";
+        appendInt(out, transfers);
+        out += ", \"allocations\": ";
+        appendInt(out, allocations);
+        out += ", \"releases\": ";
+        appendInt(out, releases);
+        out += ", \"neighbor_calls\": ";
+        appendInt(out, neighbor_calls.load());
+        out += ", \"neighbor_tiles\": ";
+        appendInt(out, neighbor_tiles.load());
+        out += ", \"peak_live_tiles\": ";
+        appendInt(out, peak_live_tiles);
+        out += '}';
+        return out;
+    }
+};
+
+#endif
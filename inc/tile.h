@@ -4,41 +4,57 @@
 #include <tuple>
 #include <list>
 #include <string>
+#include <cstdint>
 
 
-struct Point
+// Geometry is templated on the coordinate type. The program picks 16-,
+// 32- or 64-bit coordinates from the outline size (see main.cpp).
+template <typename Coord>
+struct BasicPoint
 {
-    int x;
-    int y;
+    Coord x;
+    Coord y;
 };
 
-struct Rect
+template <typename Coord>
+struct BasicRect
 {
-    Point top_right;
-    Point bottom_left;
+    BasicPoint<Coord> top_right;
+    BasicPoint<Coord> bottom_left;
 };
 
+// Stitches are 32-bit indices into the TilePool owned by the Outline
+// instead of 64-bit pointers, which keeps a Tile at 36 bytes with 32-bit
+// coordinates and at 28 bytes with 16-bit ones.
+typedef uint32_t TileIndex;
+const TileIndex NIL_TILE = UINT32_MAX;
+
+
+template <typename Coord>
+class BasicTile {
+public:
+    typedef BasicRect<Coord> Rect;
 
-class Tile {
 private:
     Rect rect;
     int id;
-    Tile* above;
-    Tile* right;
-    Tile* below;
-    Tile* left;
+    TileIndex above;
+    TileIndex right;
+    TileIndex below;
+    TileIndex left;
 
 public:
     //================================================================
     // Constructors and Destructors
     //================================================================
-    Tile(Rect rect, int id): rect(rect), id(id) {
-        above = nullptr;
-        right = nullptr;
-        below = nullptr;
-        left = nullptr;
-    }
-    ~Tile() {
+    BasicTile(): BasicTile({{0, 0}, {0, 0}}, 0) {}
+    BasicTile(Rect rect, int id): rect(rect), id(id) {
+        above = NIL_TILE;
+        right = NIL_TILE;
+        below = NIL_TILE;
+        left = NIL_TILE;
+    }
+    ~BasicTile() {
         // Do nothing
     }
 
@@ -61,35 +77,35 @@ public:
         this->id = id;
     }
 
-    Tile* getAbove() {
+    TileIndex getAbove() {
         return above;
     }
 
-    Tile* getRight() {
+    TileIndex getRight() {
         return right;
     }
 
-    Tile* getBelow() {
+    TileIndex getBelow() {
         return below;
     }
 
-    Tile* getLeft() {
+    TileIndex getLeft() {
         return left;
     }
 
-    void setAbove(Tile* above) {
+    void setAbove(TileIndex above) {
         this->above = above;
     }
 
-    void setRight(Tile* right) {
+    void setRight(TileIndex right) {
         this->right = right;
     }
 
-    void setBelow(Tile* below) {
+    void setBelow(TileIndex below) {
         this->below = below;
     }
 
-    void setLeft(Tile* left) {
+    void setLeft(TileIndex left) {
         this->left = left;
     }
 
@@ -104,7 +120,12 @@ public:
         return id > 0;
     }
 
+    // Tiles sitting in the TilePool free list carry id 0.
+    bool isFree() {
+        return id == 0;
+    }
+
 
 };
 
-#endif
\ No newline at end of file
+#endif
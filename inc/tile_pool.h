@@ -0,0 +1,182 @@
+#ifndef _TILE_POOL_H
+#define _TILE_POOL_H
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include "tile.h"
+
+
+struct MemoryUsage
+{
+    size_t live_tiles;
+    size_t capacity_tiles;
+    size_t tile_bytes;
+    size_t pool_bytes;
+    size_t index_bytes;
+};
+
+// Slab allocator for the tiles of one Outline. Tiles live in fixed-size
+// pages, so a Tile& stays valid while other tiles are allocated, and a
+// TileIndex is simply (page << PAGE_BITS) | slot. Released tiles are
+// threaded through their `above` stitch into a free list and recycled
+// before a new slot is carved out of the last page.
+//
+// Pages are reference counted so that share() can hand a read-only copy
+// of the pool to a version of the plane without copying any tile. Once a
+// pool has been shared it copies a page on the first access after the
+// share() that could write to it, unless no version holds the page any
+// more; pages are freed when the last pool holding them goes away.
+template <typename Coord>
+class TilePool {
+public:
+    typedef BasicTile<Coord> Tile;
+
+    static const unsigned PAGE_BITS = 12;
+    static const TileIndex PAGE_SIZE = TileIndex(1) << PAGE_BITS;
+    static const TileIndex PAGE_MASK = PAGE_SIZE - 1;
+
+private:
+    std::vector<std::shared_ptr<Tile>> pages;
+    TileIndex next_slot;
+    TileIndex free_head;
+    size_t live;
+    bool copy_on_write;
+    std::vector<uint8_t> owned;     // pages not shared since the last share()
+
+    void addPage() {
+        pages.emplace_back(new Tile[PAGE_SIZE], std::default_delete<Tile[]>());
+        owned.push_back(1);
+    }
+
+    Tile& writable(TileIndex index) {
+        size_t page = index >> PAGE_BITS;
+        if (!owned[page]) {
+            ownPage(page);
+        }
+        return pages[page].get()[index & PAGE_MASK];
+    }
+
+    // Makes `page` private to this pool before it is written
+    void ownPage(size_t page) {
+        if (pages[page].use_count() > 1) {
+            std::shared_ptr<Tile> copy(new Tile[PAGE_SIZE], std::default_delete<Tile[]>());
+            std::copy(pages[page].get(), pages[page].get() + PAGE_SIZE, copy.get());
+            pages[page] = copy;
+        } else {
+            // Pairs with the release in the last other holder's destructor
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        owned[page] = 1;
+    }
+
+public:
+    //================================================================
+    // Constructors and Destructors
+    //================================================================
+    TilePool(): next_slot(0), free_head(NIL_TILE), live(0), copy_on_write(false) {}
+    TilePool(const TilePool&) = delete;
+    TilePool& operator=(const TilePool&) = delete;
+    TilePool(TilePool&&) = default;
+    TilePool& operator=(TilePool&&) = default;
+
+    //================================================================
+    // Getters and Setters
+    //================================================================
+    // Forced inline: with the copy-on-write branch in it, g++ stops
+    // inlining the accessor into the stitch walks, which costs a fifth
+    // of the insert time.
+    __attribute__((always_inline)) Tile& operator[](TileIndex index) {
+        if (copy_on_write) {
+            return writable(index);
+        }
+        return pages[index >> PAGE_BITS].get()[index & PAGE_MASK];
+    }
+
+    size_t size() {
+        return live;
+    }
+
+    size_t capacity() {
+        return pages.size() * PAGE_SIZE;
+    }
+
+    // Upper bound (exclusive) of every index handed out so far.
+    TileIndex slotCount() {
+        return next_slot;
+    }
+
+    size_t bytes() {
+        return capacity() * sizeof(Tile) + pages.capacity() * sizeof(pages[0]);
+    }
+
+    //================================================================
+    // Public Methods
+    //================================================================
+    // Read-only pool holding the same pages. Tiles read through it keep
+    // their contents as of this call, whatever this pool does later.
+    TilePool share() {
+        TilePool shared;
+        shared.pages = pages;
+        shared.next_slot = next_slot;
+        shared.free_head = free_head;
+        shared.live = live;
+        shared.owned.assign(pages.size(), 1);
+        copy_on_write = true;
+        std::fill(owned.begin(), owned.end(), 0);
+        return shared;
+    }
+
+    // Copies every page a version still holds, after which the pool is
+    // private again and its pages may be read from several threads.
+    void unshare() {
+        for (size_t page = 0; page < pages.size() && copy_on_write; page++) {
+            if (!owned[page]) {
+                ownPage(page);
+            }
+        }
+        copy_on_write = false;
+    }
+
+    TileIndex allocate(BasicRect<Coord> rect, int id) {
+        TileIndex index;
+        if (free_head != NIL_TILE) {
+            index = free_head;
+            free_head = (*this)[index].getAbove();
+        } else {
+            if ((next_slot & PAGE_MASK) == 0) {
+                addPage();
+            }
+            index = next_slot++;
+        }
+        (*this)[index] = Tile(rect, id);
+        live++;
+        return index;
+    }
+
+    // Carves `count` consecutive fresh slots and returns the first one.
+    // The tiles are default-constructed and counted as live; the caller
+    // fills them in, possibly from several threads.
+    TileIndex allocateRange(TileIndex count) {
+        TileIndex first = next_slot;
+        next_slot += count;
+        while (pages.size() * PAGE_SIZE < next_slot) {
+            addPage();
+        }
+        live += count;
+        return first;
+    }
+
+    void release(TileIndex index) {
+        Tile& tile = (*this)[index];
+        tile = Tile();
+        tile.setAbove(free_head);
+        free_head = index;
+        live--;
+    }
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef _TILE_REGISTRY_H
+#define _TILE_REGISTRY_H
+
+#include <vector>
+#include <cstdint>
+#include "tile.h"
+
+
+// Set of live tiles with O(1) insert and erase. Tiles are kept densely
+// in `tiles`; `slots[index]` remembers where a tile sits so erase can
+// swap the last entry into the hole.
+class TileRegistry {
+private:
+    std::vector<TileIndex> tiles;
+    std::vector<uint32_t> slots;
+
+public:
+    typedef std::vector<TileIndex>::const_iterator const_iterator;
+
+    //================================================================
+    // Getters and Setters
+    //================================================================
+    size_t size() const {
+        return tiles.size();
+    }
+
+    const_iterator begin() const {
+        return tiles.begin();
+    }
+
+    const_iterator end() const {
+        return tiles.end();
+    }
+
+    size_t bytes() const {
+        return tiles.capacity() * sizeof(TileIndex) + slots.capacity() * sizeof(uint32_t);
+    }
+
+    //================================================================
+    // Public Methods
+    //================================================================
+    void reserve(size_t count) {
+        tiles.reserve(count);
+        slots.reserve(count);
+    }
+
+    void insert(TileIndex tile) {
+        if (tile >= slots.size()) {
+            slots.resize(tile + 1);
+        }
+        slots[tile] = tiles.size();
+        tiles.push_back(tile);
+    }
+
+    void erase(TileIndex tile) {
+        uint32_t slot = slots[tile];
+        TileIndex last = tiles.back();
+        tiles[slot] = last;
+        slots[last] = slot;
+        tiles.pop_back();
+    }
+};
+
+#endif
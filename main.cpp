@@ -1,143 +1,769 @@
 #include <iostream>
-#include <fstream>
-#include <sstream>
 #include <list>
 #include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
 #include "outline.h"
+#include "layer_stack.h"
+#include "parallel.h"
+#include "command_reader.h"
+#include "output_writer.h"
+#include "snapshot.h"
+#include "phase_timer.h"
+#include "server.h"
+#include "rasterizer.h"
+#include "query_pipeline.h"
 
 
-int main(int argc, char const *argv[]) {
+// Settings from the command line
+struct Options
+{
+    std::vector<std::string> args;
+    bool mem_report = false;
+    bool walk_report = false;
+    bool use_locator = true;
+    bool use_freeze = true;
+    bool use_compact = true;
+    unsigned threads = defaultThreadCount();
+    bool async_output = false;
+    bool bulk_load = false;
+    unsigned shards = 1;
+    std::string save_snapshot;
+    std::string load_snapshot;
+    bool timings = false;
+    bool stats_report = false;
+    bool track_neighbors = false;
+    bool check_neighbors = false;
+    bool layered = false;
+    std::string serve_path;
+    int coord_bits = 0;         // 0: the narrowest type the outline fits
+    std::string render_path;
+    int render_width = 1024;
+    std::string render_window;  // "x,y,w,h"; empty for the whole outline
+    long long spacing = 0;      // --spacing-report distance; 0 for none
+    std::string density_path;
+    int density_columns = 256;
+    int density_rows = 256;
+    bool pipeline = false;
+};
+
+// Everything after the outline size is known, for one coordinate type
+template <typename Coord>
+int run(const Options& options, CommandReader& reader, SnapshotFile& snapshot, PhaseTimer& timer, Coord outline_width, Coord outline_height) {
+    typedef BasicOutline<Coord> Outline;
+    typedef BasicBlockRect<Coord> BlockRect;
+    typedef BasicRect<Coord> Rect;
+    typedef BasicPoint<Coord> Point;
+    bool serving = !options.serve_path.empty();
+
+    // Layer 0 is the only plane without --layers, and the layer of every
+    // command before the first L line with it. With --layers every layer,
+    // layer 0 included, is created by the first command that uses it, and
+    // `outline` is a spare plane that no command reaches.
+    LayerStack<Coord> layer_stack(outline_width, outline_height);
+    std::unique_ptr<Outline> spare(options.layered ? new Outline(outline_width, outline_height) : nullptr);
+    Outline& outline = spare ? *spare : layer_stack.getLayer(0);
+    if (!options.load_snapshot.empty()) {
+        timer.enter(PhaseTimer::INSERT);
+        outline.loadSnapshot(snapshot);
+    }
+    outline.setLocatorEnabled(options.use_locator);
+    outline.setNeighborTracking(options.track_neighbors);
+
     //================================================================//
-    //                   Parse the input commands                     //
+    //                     Parse the input commands                   //
     //================================================================//
-    std::list<std::string> commands;
-    if (argc == 1) {
-        std::string command;
-        while (std::getline(std::cin, command)) {
-            commands.push_back(command);
+    // Once only P queries remain, or a run of queries is at least as long
+    // as the plane is large, the queries run against the frozen index.
+    // A run of queries that walks the stitches (A queries, and P queries
+    // while the plane is not frozen) compacts the plane once it has walked
+    // an eighth of the plane's tile count (see BasicOutline::compact()).
+    //
+    // Runs of block lines are buffered until the next query, deletion or
+    // the end of input and placed together by createBlocks(). With --bulk
+    // or --shards, a run at least as large as the plane so far is built in
+    // one go instead, by the sweep or by the sharded loader.
+    //
+    // With --layers the commands are only routed to their layer's queue
+    // here; the layers replay their queues in parallel after the input
+    // has been read.
+    //
+    // With --pipeline, P and A queries are held until their run ends. A
+    // run of at least QueryPipeline::MIN_RUN queries followed by an edit
+    // is answered on a version of the plane by a background thread while
+    // the edits go on; shorter runs and the last run are answered here.
+    std::list<QueryAnswer> query_answers;
+    std::unique_ptr<QueryPipeline<Coord>> pipeline;
+    if (options.pipeline && !options.layered && !serving) {
+        pipeline.reset(new QueryPipeline<Coord>(std::max(1u, options.threads - 1)));
+    }
+    std::vector<Command> held_queries;
+    size_t query_run = 0;
+    size_t walk_run = 0;
+    // Counts the queries answered by stitch walks since the last edit and
+    // compacts the plane once in a run that has walked long enough
+    auto noteWalk = [&](const Command& query) {
+        if (query.type == Command::POINT && outline.isFrozen()) {
+            return;
         }
-    } else
-    if (argc == 2) {
-        std::cerr << "Error: Invalid number of arguments" << std::endl;
-        std::cerr << "Usage: " << argv[0] << " <input_file> <output_file>" << std::endl;
-        exit(1);
-    } else
-    if (argc == 3) {
-        std::ifstream input_file(argv[1]);
-        if (!input_file.is_open()) {
-            std::cerr << "Error: Unable to open input file" << std::endl;
-            exit(1);
+        walk_run++;
+        if (options.use_compact && walk_run == outline.blocks.size() / Outline::COMPACT_RUN_DIVISOR + 1) {
+            outline.compact();
+        }
+    };
+    std::vector<BlockRect> pending_blocks;
+    // The blocks in input order, kept for the drawing order until a
+    // deletion or a snapshot makes the history incomplete
+    std::vector<BlockRect> history;
+    bool keep_history = options.args.size() == 2 && !options.layered && options.load_snapshot.empty();
+    auto flushBlocks = [&]() {
+        if (pending_blocks.empty()) {
+            return;
+        }
+        if (keep_history) {
+            history.insert(history.end(), pending_blocks.begin(), pending_blocks.end());
+        }
+        if (pending_blocks.size() >= outline.block_ids.size() && options.shards > 1) {
+            outline.shardedLoad(pending_blocks, options.shards, options.threads);
+        } else
+        if (pending_blocks.size() >= outline.block_ids.size() && options.bulk_load) {
+            outline.bulkLoad(pending_blocks);
+        } else {
+            outline.createBlocks(pending_blocks);
+        }
+        pending_blocks.clear();
+    };
+    auto flushQueries = [&](bool at_end) {
+        if (held_queries.size() >= QueryPipeline<Coord>::MIN_RUN && !at_end) {
+            pipeline->submit(outline, held_queries, query_answers.size());
+            return;
+        }
+        for (const Command& query : held_queries) {
+            if (query.type == Command::POINT) {
+                query_run++;
+                if (options.use_freeze && !outline.isFrozen() && (at_end || query_run >= outline.blocks.size())) {
+                    outline.freeze();
+                }
+            }
+            noteWalk(query);
+            query_answers.push_back(QueryPipeline<Coord>::answer(outline, query));
+        }
+        held_queries.clear();
+    };
+    int current_layer = 0;
+    Command command;
+    for (;;) {
+        timer.enter(PhaseTimer::PARSE);
+        if (!reader.next(command)) {
+            break;
+        }
+        if (command.type == Command::LAYER || command.type == Command::CROSS) {
+            if (!options.layered) {
+                std::cerr << "Error: line " << reader.getLineNumber() << ": layer commands need --layers" << std::endl;
+                exit(1);
+            }
+            if (command.type == Command::LAYER) {
+                current_layer = command.id;
+                layer_stack.getLayer(current_layer);
+            } else {
+                layer_stack.addCrossQuery(command.point, reader.getLineNumber());
+            }
+            continue;
+        }
+        if (options.layered) {
+            layer_stack.add(current_layer, command, reader.getLineNumber());
+            continue;
+        }
+        if (command.type != Command::BLOCK && !pending_blocks.empty()) {
+            timer.enter(PhaseTimer::INSERT);
+            flushBlocks();
+        }
+        if (command.type == Command::POINT || command.type == Command::AREA) {
+            timer.enter(PhaseTimer::QUERY);
+        } else {
+            timer.enter(PhaseTimer::INSERT);
         }
 
-        std::string command;
-        while (std::getline(input_file, command)) {
-            commands.push_back(command);
+        if (pipeline && (command.type == Command::POINT || command.type == Command::AREA)) {
+            held_queries.push_back(command);
+            continue;
         }
-    } else {
-        std::cerr << "Error: Invalid number of arguments" << std::endl;
-        std::cerr << "Usage: " << argv[0] << " <input_file> <output_file>" << std::endl;
+        if (!held_queries.empty()) {
+            timer.enter(PhaseTimer::QUERY);
+            flushQueries(false);
+            timer.enter(PhaseTimer::INSERT);
+        }
+
+        if (command.type == Command::POINT) {
+            query_run++;
+            if (options.use_freeze && !outline.isFrozen() && (reader.inQueryTail() || query_run >= outline.blocks.size())) {
+                outline.freeze();
+            }
+            noteWalk(command);
+            TileIndex tile = outline.findTileatPoint(outline.narrow(command.point));
+            Point corner = outline.getTile(tile).getRect().bottom_left;
+            query_answers.push_back({corner.x, corner.y});
+        } else
+        if (command.type == Command::AREA) {
+            noteWalk(command);
+            QueryAnswer counts = {0, 0};
+            outline.enumerateArea(outline.narrow(command.rect), [&](TileIndex tile) {
+                if (outline.getTile(tile).isTile()) {
+                    counts.first++;
+                } else {
+                    counts.second++;
+                }
+            });
+            query_answers.push_back(counts);
+        } else
+        if (command.type == Command::DELETE) {
+            query_run = 0;
+            walk_run = 0;
+            keep_history = false;
+            history.clear();
+            if (!outline.deleteBlock(command.id)) {
+                std::cerr << "Error: line " << reader.getLineNumber() << ": no block with id " << command.id << std::endl;
+                exit(1);
+            }
+        } else {
+            query_run = 0;
+            walk_run = 0;
+            pending_blocks.push_back({outline.narrow(command.rect), command.id});
+        }
+    }
+    timer.enter(PhaseTimer::INSERT);
+    flushBlocks();
+    if (pipeline) {
+        timer.enter(PhaseTimer::QUERY);
+        flushQueries(true);
+        pipeline->finish();
+        outline.unshare();
+    }
+    if (!reader.error().empty()) {
+        std::cerr << "Error: " << reader.error() << std::endl;
         exit(1);
     }
+    if (options.layered) {
+        for (const std::pair<const int, std::unique_ptr<Outline>>& layer : layer_stack.getLayers()) {
+            layer.second->setLocatorEnabled(options.use_locator);
+            layer.second->setNeighborTracking(options.track_neighbors);
+        }
+        if (!layer_stack.run(options.threads, options.bulk_load || options.shards > 1, options.use_freeze)) {
+            std::cerr << "Error: " << layer_stack.error() << std::endl;
+            exit(1);
+        }
+    }
 
     //================================================================//
-    //                     Parse the outline size                     //
+    //                          Server mode                           //
     //================================================================//
-    int outline_width, outline_height;
-    std::string command = commands.front();
-    commands.pop_front();
-    std::istringstream iss(command);
-    iss >> outline_width >> outline_height;
-    Outline outline(outline_width, outline_height);
+    // The plane built so far stays resident and answers requests until
+    // the server stops; then only the snapshot, if asked for, is written.
+    if (serving) {
+        timer.stop();
+        Server<Coord> server(outline, options.threads, options.use_freeze);
+        if (!server.open(options.serve_path)) {
+            std::cerr << "Error: " << server.error() << std::endl;
+            exit(1);
+        }
+        server.run();
+        if (!server.error().empty()) {
+            std::cerr << "Error: " << server.error() << std::endl;
+            exit(1);
+        }
+    }
+    timer.enter(PhaseTimer::OUTPUT);
+    if (!options.save_snapshot.empty() && !outline.saveSnapshot(options.save_snapshot)) {
+        std::cerr << "Error: Unable to write snapshot " << options.save_snapshot << std::endl;
+        exit(1);
+    }
+    if (serving) {
+        return 0;
+    }
 
     //================================================================//
-    //                     Parse the input commands                   //
+    //                            Reports                             //
     //================================================================//
-    std::list<Point> find_point_command_answers;
-    for (std::string command : commands) {
-        std::istringstream iss(command);
-        std::string first_word;
-        iss >> first_word;
-        if (first_word == "P") {
-            int x, y;
-            iss >> x >> y;
-            Point point = {x, y};
-            Tile* tile = outline.findTileatPoint(outline.start, point);
-            find_point_command_answers.push_back(tile->getRect().bottom_left);
-        } else {
-            int id;
-            id = std::stoi(first_word);
-            int x, y, w, h;
-            iss >> x >> y >> w >> h;
-            Rect rect = {{x + w, y + h}, {x, y}};
-            outline.createBlock(rect, id);
+    // Without --layers the stack holds only layer 0, so every report
+    // below covers exactly the plane it always did.
+    const std::map<int, std::unique_ptr<Outline>>& layers = layer_stack.getLayers();
+    if (options.mem_report) {
+        MemoryUsage usage = {0, 0, sizeof(BasicTile<Coord>), 0, 0};
+        for (const std::pair<const int, std::unique_ptr<Outline>>& layer : layers) {
+            MemoryUsage layer_usage = layer.second->memoryUsage();
+            usage.live_tiles += layer_usage.live_tiles;
+            usage.capacity_tiles += layer_usage.capacity_tiles;
+            usage.pool_bytes += layer_usage.pool_bytes;
+            usage.index_bytes += layer_usage.index_bytes;
+        }
+        size_t total_bytes = usage.pool_bytes + usage.index_bytes;
+        std::cerr << "tiles: " << usage.live_tiles << " live, " << usage.capacity_tiles << " reserved" << std::endl;
+        std::cerr << "sizeof(Tile): " << usage.tile_bytes << " B" << std::endl;
+        std::cerr << "pool: " << usage.pool_bytes << " B, index: " << usage.index_bytes << " B" << std::endl;
+        std::cerr << "bytes per live tile: " << (usage.live_tiles ? double(total_bytes) / usage.live_tiles : 0.0) << std::endl;
+    }
+    WalkStats walk = {0, 0};
+    size_t block_count = 0;
+    size_t tile_count = 0;
+    for (const std::pair<const int, std::unique_ptr<Outline>>& layer : layers) {
+        WalkStats layer_walk = layer.second->getWalkStats();
+        walk.lookups += layer_walk.lookups;
+        walk.steps += layer_walk.steps;
+        block_count += layer.second->block_ids.size();
+        tile_count += layer.second->blocks.size();
+    }
+    if (options.walk_report) {
+        std::cerr << "point lookups: " << walk.lookups << ", stitch steps: " << walk.steps << std::endl;
+        std::cerr << "average walk length: " << (walk.lookups ? double(walk.steps) / walk.lookups : 0.0) << std::endl;
+    }
+    if (options.spacing > 0) {
+        for (const std::pair<const int, std::unique_ptr<Outline>>& layer : layers) {
+            Outline& plane = *layer.second;
+            std::string pairs;
+            size_t count = 0;
+            plane.forEachClosePair(options.spacing, [&](TileIndex block, TileIndex other, long long gap) {
+                appendInt(pairs, plane.getTile(block).getId());
+                pairs += ' ';
+                appendInt(pairs, plane.getTile(other).getId());
+                pairs += ' ';
+                appendInt(pairs, gap);
+                pairs += '\n';
+                count++;
+            });
+            if (options.layered) {
+                std::cerr << "L " << layer.first << std::endl;
+            }
+            std::cerr << "block pairs closer than " << options.spacing << ": " << count << std::endl << pairs;
         }
     }
 
     //================================================================//
     //                     Write the output to file                   //
     //================================================================//
-    if (argc == 1) {
-        std::cout << outline.blocks.size() << std::endl;
-        outline.blocks.sort([](Tile* a, Tile* b) {
-            return a->getId() < b->getId();
-        });
-        for (Tile* block : outline.blocks) {
-            if (block->getId() == -1) {
-                break;
+    // Neighbor counts only read stitches, so blocks are reported in
+    // parallel chunks that are written back in id order. With
+    // --track-neighbors the counts are already maintained and only read;
+    // --check-neighbors also walks every block and compares.
+    timer.enter(PhaseTimer::REPORT);
+    if (options.check_neighbors) {
+        for (const std::pair<const int, std::unique_ptr<Outline>>& layer : layers) {
+            Outline& plane = *layer.second;
+            for (const std::pair<const int, TileIndex>& block : plane.block_ids) {
+                NeighborCount kept = plane.neighborCount(block.second);
+                NeighborCount walked = plane.neighborFinding(block.second);
+                if (kept.solid_count != walked.solid_count || kept.space_count != walked.space_count) {
+                    std::cerr << "Error: block " << block.first << " has maintained neighbor counts " << kept.solid_count << " " << kept.space_count
+                              << " but a walk finds " << walked.solid_count << " " << walked.space_count << std::endl;
+                    exit(1);
+                }
             }
-            NeighborCount neighbor_count = outline.neighborFinding(block);
-            std::cout << block->getId() << " " << neighbor_count.solid_count << " " << neighbor_count.space_count << std::endl;
         }
-        for (Point point : find_point_command_answers) {
-            std::cout << point.x << " " << point.y << std::endl;
+    }
+    const size_t report_grain = 4096;
+    std::vector<std::vector<std::string>> layer_reports;
+    for (const std::pair<const int, std::unique_ptr<Outline>>& layer : layers) {
+        Outline& plane = *layer.second;
+        std::vector<std::pair<int, TileIndex>> report_blocks(plane.block_ids.begin(), plane.block_ids.end());
+        std::vector<std::string> report_chunks((report_blocks.size() + report_grain - 1) / report_grain);
+        parallelFor(report_blocks.size(), report_grain, options.threads, [&](size_t begin, size_t end) {
+            std::string& chunk = report_chunks[begin / report_grain];
+            for (size_t i = begin; i < end; i++) {
+                NeighborCount neighbor_count = plane.neighborCount(report_blocks[i].second);
+                appendInt(chunk, report_blocks[i].first);
+                chunk += ' ';
+                appendInt(chunk, neighbor_count.solid_count);
+                chunk += ' ';
+                appendInt(chunk, neighbor_count.space_count);
+                chunk += '\n';
+            }
+        });
+        layer_reports.push_back(std::move(report_chunks));
+    }
+
+    timer.enter(PhaseTimer::OUTPUT);
+    OutputWriter output;
+    if (!output.open(options.args.size() == 2 ? options.args[1] : std::string(), options.async_output)) {
+        std::cerr << "Error: Unable to open output file" << std::endl;
+        exit(1);
+    }
+
+    // With --layers every layer gets an "L <layer>" header line, then the
+    // answers of all layers follow in input order.
+    std::vector<std::vector<std::string>>::const_iterator report = layer_reports.begin();
+    for (const std::pair<const int, std::unique_ptr<Outline>>& layer : layers) {
+        if (options.layered) {
+            output.write("L ").write(layer.first).write('\n');
         }
-    } else
-    if (argc == 3) {
-        std::ofstream output_file(argv[2]);
-        if (!output_file.is_open()) {
-            std::cerr << "Error: Unable to open output file" << std::endl;
-            exit(1);
+        output.write(layer.second->blocks.size()).write('\n');
+        for (const std::string& chunk : *report++) {
+            output.write(chunk);
         }
-
-        output_file << outline.blocks.size() << std::endl;
-        outline.blocks.sort([](Tile* a, Tile* b) {
-            return a->getId() < b->getId();
-        });
-        for (Tile* block : outline.blocks) {
-            if (block->getId() == -1) {
-                continue;;
+    }
+    size_t query_lines = query_answers.size();
+    if (options.layered) {
+        const std::vector<QueryAnswer>& answers = layer_stack.getAnswers();
+        size_t slot = 0;
+        query_lines = layer_stack.getLineSlots().size();
+        for (size_t slots : layer_stack.getLineSlots()) {
+            // An X query before any layer exists answers with an empty line
+            if (slots == 0) {
+                output.write('\n');
+            }
+            for (size_t i = 0; i < slots; i++, slot++) {
+                output.write(answers[slot].first).write(' ').write(answers[slot].second).write(i + 1 < slots ? ' ' : '\n');
             }
-            NeighborCount neighbor_count = outline.neighborFinding(block);
-            output_file << block->getId() << " " << neighbor_count.solid_count << " " << neighbor_count.space_count << std::endl;
         }
-        for (Point point : find_point_command_answers) {
-            output_file << point.x << " " << point.y << std::endl;
+    }
+    // Runs answered by the pipeline go back between the answers given
+    // here, at the position each run was submitted at.
+    std::list<typename QueryPipeline<Coord>::Run> no_runs;
+    const std::list<typename QueryPipeline<Coord>::Run>& runs = pipeline ? pipeline->getRuns() : no_runs;
+    typename std::list<typename QueryPipeline<Coord>::Run>::const_iterator run = runs.begin();
+    size_t position = 0;
+    for (std::list<QueryAnswer>::const_iterator answer = query_answers.begin();; ++answer, position++) {
+        for (; run != runs.end() && run->position == position; ++run) {
+            query_lines += run->answers.size();
+            for (QueryAnswer run_answer : run->answers) {
+                output.write(run_answer.first).write(' ').write(run_answer.second).write('\n');
+            }
         }
+        if (answer == query_answers.end()) {
+            break;
+        }
+        output.write(answer->first).write(' ').write(answer->second).write('\n');
     }
 
     // Optional: Write the drawing to a file
     //================================================================//
     //                           Drawing                              //
     //================================================================//
-    std::string draw_file_name = std::string(argv[2]) + "_drawing.txt";
-    std::ofstream drawing_file(draw_file_name);
-    if (!drawing_file.is_open()) {
-        std::cerr << "Error: Unable to open drawing file" << std::endl;
+    // One drawing per layer; with --layers the file names carry the layer.
+    // Space tiles come first, then the blocks in id order, so the drawing
+    // does not depend on the order the tiles happen to sit in the
+    // registry. The space tiles keep the order of the original list-based
+    // plane when the block history is complete (see
+    // BasicOutline::spaceTilesInListOrder()), and go bottom to top and
+    // left to right otherwise.
+    std::vector<std::unique_ptr<OutputWriter>> drawing_files;
+    if (options.args.size() == 2) {
+        for (const std::pair<const int, std::unique_ptr<Outline>>& layer : layers) {
+            Outline& plane = *layer.second;
+            std::string draw_file_name = options.args[1] + (options.layered ? "_L" + std::to_string(layer.first) : std::string()) + "_drawing.txt";
+            drawing_files.emplace_back(new OutputWriter);
+            OutputWriter& drawing_file = *drawing_files.back();
+            if (!drawing_file.open(draw_file_name, options.async_output)) {
+                std::cerr << "Error: Unable to open drawing file" << std::endl;
+                exit(1);
+            }
+
+            drawing_file.write(plane.blocks.size()).write('\n');
+            drawing_file.write((long long)plane.getWidth()).write(' ').write((long long)plane.getHeight()).write('\n');
+            std::vector<TileIndex> tiles;
+            if (keep_history) {
+                tiles = plane.spaceTilesInListOrder(history);
+            } else {
+                for (TileIndex tile : plane.blocks) {
+                    if (plane.getTile(tile).isSpace()) {
+                        tiles.push_back(tile);
+                    }
+                }
+                std::sort(tiles.begin(), tiles.end(), [&plane](TileIndex a, TileIndex b) {
+                    Point corner_a = plane.getTile(a).getRect().bottom_left;
+                    Point corner_b = plane.getTile(b).getRect().bottom_left;
+                    return corner_a.y != corner_b.y ? corner_a.y < corner_b.y : corner_a.x < corner_b.x;
+                });
+            }
+            tiles.reserve(plane.blocks.size());
+            for (const std::pair<const int, TileIndex>& block : plane.block_ids) {
+                tiles.push_back(block.second);
+            }
+            for (TileIndex block : tiles) {
+                Rect rect = plane.getTile(block).getRect();
+                int id = plane.getTile(block).getId();
+                long long x, y, w, h;
+                x = rect.bottom_left.x;
+                y = rect.bottom_left.y;
+                w = rect.top_right.x - rect.bottom_left.x;
+                h = rect.top_right.y - rect.bottom_left.y;
+                drawing_file.write(id).write(' ').write(x).write(' ').write(y).write(' ').write(w).write(' ').write(h).write('\n');
+            }
+        }
+    }
+
+    bool written = output.close();
+    for (std::unique_ptr<OutputWriter>& drawing_file : drawing_files) {
+        written = drawing_file->close() && written;
+    }
+    if (!written) {
+        std::cerr << "Error: Unable to write output" << std::endl;
         exit(1);
     }
 
-    drawing_file << outline.blocks.size() << std::endl;
-    drawing_file << outline.getWidth() << " " << outline.getHeight() << std::endl;
-    for (Tile* block : outline.blocks) {
-        Rect rect = block->getRect();
-        int id = block->getId();
-        int x, y, w, h;
-        x = rect.bottom_left.x;
-        y = rect.bottom_left.y;
-        w = rect.top_right.x - rect.bottom_left.x;
-        h = rect.top_right.y - rect.bottom_left.y;
-        drawing_file << id << " " << x << " " << y << " " << w << " " << h << std::endl;
+    //================================================================//
+    //                           Rendering                            //
+    //================================================================//
+    // Images are rasterized from the tiles directly; the image height
+    // follows the aspect ratio of the window. A .png path is written as
+    // PNG, anything else as PPM. With --layers the file names carry the
+    // layer in front of the extension.
+    if (!options.render_path.empty()) {
+        BasicRect<long long> window = {{outline.getWidth(), outline.getHeight()}, {0, 0}};
+        long long x, y, w, h;
+        char tail;
+        if (!options.render_window.empty()) {
+            if (std::sscanf(options.render_window.c_str(), "%lld,%lld,%lld,%lld%c", &x, &y, &w, &h, &tail) != 4) {
+                std::cerr << "Error: --render-window takes x,y,w,h" << std::endl;
+                exit(1);
+            }
+            window = {{std::min(x + w, window.top_right.x), std::min(y + h, window.top_right.y)}, {std::max(x, 0LL), std::max(y, 0LL)}};
+        }
+        if (window.bottom_left.x >= window.top_right.x || window.bottom_left.y >= window.top_right.y) {
+            std::cerr << "Error: The render window does not overlap the outline" << std::endl;
+            exit(1);
+        }
+        long long window_width = window.top_right.x - window.bottom_left.x;
+        long long window_height = window.top_right.y - window.bottom_left.y;
+        int image_height = int(std::max(1.0, std::min(65535.0, std::round(double(options.render_width) * window_height / window_width))));
+
+        for (const std::pair<const int, std::unique_ptr<Outline>>& layer : layers) {
+            std::string path = options.render_path;
+            size_t dot = path.rfind('.');
+            if (dot == std::string::npos || path.find('/', dot) != std::string::npos) {
+                dot = path.size();
+            }
+            if (options.layered) {
+                path.insert(dot, "_L" + std::to_string(layer.first));
+            }
+            Image image(options.render_width, image_height);
+            Rasterizer<Coord>(*layer.second, window).render(image, options.threads);
+            bool png = path.size() >= 4 && path.compare(path.size() - 4, 4, ".png") == 0;
+            if (!(png ? image.writePNG(path) : image.writePPM(path))) {
+                std::cerr << "Error: Unable to write image " << path << std::endl;
+                exit(1);
+            }
+        }
+    }
+
+    //================================================================//
+    //                          Density maps                          //
+    //================================================================//
+    // Utilization, tile and space maps per bin (see DensityMap). A .csv
+    // path is written as three CSV matrices, anything else as one binary
+    // file. With --layers the file names carry the layer, as for images.
+    if (!options.density_path.empty()) {
+        for (const std::pair<const int, std::unique_ptr<Outline>>& layer : layers) {
+            std::string path = options.density_path;
+            size_t dot = path.rfind('.');
+            if (dot == std::string::npos || path.find('/', dot) != std::string::npos) {
+                dot = path.size();
+            }
+            if (options.layered) {
+                path.insert(dot, "_L" + std::to_string(layer.first));
+            }
+            DensityMap map = layer.second->densityMap(options.density_columns, options.density_rows, options.threads);
+            bool csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+            if (!(csv ? map.writeCSV(path) : map.writeBinary(path))) {
+                std::cerr << "Error: Unable to write density map " << path << std::endl;
+                exit(1);
+            }
+        }
+    }
+
+    // One JSON object per run, in seconds, for bench/run_bench.sh
+    timer.stop();
+    if (options.timings) {
+        std::cerr << "{\"blocks\": " << block_count << ", \"tiles\": " << tile_count
+                  << ", \"queries\": " << query_lines << ", \"phases\": " << timer.json() << "}" << std::endl;
+    }
+    if (options.stats_report) {
+        std::string counters;
+        for (const std::pair<const int, std::unique_ptr<Outline>>& layer : layers) {
+            counters += counters.empty() ? "" : ", ";
+            counters += layer.second->getStats().json();
+        }
+        std::cerr << "{\"instrumented\": " << (STATS_ENABLED ? "true" : "false")
+                  << ", \"lookups\": " << walk.lookups << ", \"steps\": " << walk.steps
+                  << ", \"counters\": " << (options.layered ? "[" + counters + "]" : counters) << ", \"phases\": " << timer.json() << "}" << std::endl;
     }
 
     return 0;
 }
+
+int main(int argc, char const *argv[]) {
+    //================================================================//
+    //                   Parse the command line                       //
+    //================================================================//
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--mem-report") {
+            options.mem_report = true;
+        } else
+        if (arg == "--walk-report") {
+            options.walk_report = true;
+        } else
+        if (arg == "--no-locator") {
+            options.use_locator = false;
+        } else
+        if (arg == "--no-freeze") {
+            options.use_freeze = false;
+        } else
+        if (arg == "--no-compact") {
+            options.use_compact = false;
+        } else
+        if (arg == "--bulk") {
+            options.bulk_load = true;
+        } else
+        if (arg == "--layers") {
+            options.layered = true;
+        } else
+        if (arg == "--track-neighbors") {
+            options.track_neighbors = true;
+        } else
+        if (arg == "--check-neighbors") {
+            options.track_neighbors = true;
+            options.check_neighbors = true;
+        } else
+        if (arg == "--stats") {
+            options.stats_report = true;
+        } else
+        if (arg == "--timings") {
+            options.timings = true;
+        } else
+        if (arg == "--async-output") {
+            options.async_output = true;
+        } else
+        if (arg == "--save-snapshot" && i + 1 < argc) {
+            options.save_snapshot = argv[++i];
+        } else
+        if (arg == "--serve" && i + 1 < argc) {
+            options.serve_path = argv[++i];
+        } else
+        if (arg == "--load-snapshot" && i + 1 < argc) {
+            options.load_snapshot = argv[++i];
+        } else
+        if (arg == "--shards" && i + 1 < argc) {
+            options.shards = std::max(1, std::atoi(argv[++i]));
+        } else
+        if (arg == "--render" && i + 1 < argc) {
+            options.render_path = argv[++i];
+        } else
+        if (arg == "--render-width" && i + 1 < argc) {
+            options.render_width = std::max(1, std::min(65535, std::atoi(argv[++i])));
+        } else
+        if (arg == "--render-window" && i + 1 < argc) {
+            options.render_window = argv[++i];
+        } else
+        if (arg == "--density-map" && i + 1 < argc) {
+            options.density_path = argv[++i];
+        } else
+        if (arg == "--density-bins" && i + 1 < argc) {
+            const char* bins = argv[++i];
+            char tail;
+            bool square = std::sscanf(bins, "%d%c", &options.density_columns, &tail) == 1;
+            if (square) {
+                options.density_rows = options.density_columns;
+            }
+            if ((!square && std::sscanf(bins, "%dx%d%c", &options.density_columns, &options.density_rows, &tail) != 2) || options.density_columns <= 0 || options.density_rows <= 0) {
+                std::cerr << "Error: --density-bins takes <n> or <columns>x<rows>" << std::endl;
+                exit(1);
+            }
+        } else
+        if (arg == "--coord" && i + 1 < argc) {
+            options.coord_bits = std::atoi(argv[++i]);
+            if (options.coord_bits != 16 && options.coord_bits != 32 && options.coord_bits != 64) {
+                std::cerr << "Error: --coord takes 16, 32 or 64" << std::endl;
+                exit(1);
+            }
+        } else
+        if (arg == "--pipeline") {
+            options.pipeline = true;
+        } else
+        if (arg == "--spacing-report" && i + 1 < argc) {
+            options.spacing = std::atoll(argv[++i]);
+            if (options.spacing <= 0 || options.spacing > (1LL << 62)) {
+                std::cerr << "Error: --spacing-report takes a positive distance" << std::endl;
+                exit(1);
+            }
+        } else
+        if (arg == "--threads" && i + 1 < argc) {
+            options.threads = std::max(1, std::atoi(argv[++i]));
+        } else {
+            options.args.push_back(arg);
+        }
+    }
+
+    //================================================================//
+    //                     Parse the outline size                     //
+    //================================================================//
+    // A server takes at most an input file to start from, and needs it
+    // or a snapshot for the outline size.
+    bool serving = !options.serve_path.empty();
+    if (serving ? options.args.size() > 1 || (options.args.empty() && options.load_snapshot.empty()) : options.args.size() != 0 && options.args.size() != 2) {
+        std::cerr << "Error: Invalid number of arguments" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " [--mem-report] [--walk-report] [--no-locator] [--no-freeze] [--no-compact] [--threads <n>] [--async-output] [--bulk] [--shards <n>] [--save-snapshot <file>] [--load-snapshot <file>] [--timings] [--stats] [--track-neighbors] [--check-neighbors] [--layers] [--coord 16|32|64] [--render <image>] [--render-width <px>] [--render-window x,y,w,h] [--density-map <file>] [--density-bins <columns>x<rows>] [--spacing-report <d>] [--pipeline] <input_file> <output_file>" << std::endl;
+        std::cerr << "       " << argv[0] << " --serve <socket|-> [--load-snapshot <file>] [--save-snapshot <file>] [options] [<input_file>]" << std::endl;
+        exit(1);
+    }
+    if (serving && options.layered) {
+        std::cerr << "Error: --serve keeps a single layer and cannot be combined with --layers" << std::endl;
+        exit(1);
+    }
+    if (options.layered && (!options.load_snapshot.empty() || !options.save_snapshot.empty())) {
+        std::cerr << "Error: Snapshots hold a single layer and cannot be combined with --layers" << std::endl;
+        exit(1);
+    }
+    PhaseTimer timer(options.timings || options.stats_report);
+    timer.enter(PhaseTimer::PARSE);
+    CommandReader reader;
+    // A server started from a snapshot alone reads no commands
+    std::string input_path = options.args.empty() ? std::string() : options.args[0];
+    if (serving && options.args.empty()) {
+        input_path = "/dev/null";
+    }
+    if (!reader.open(input_path)) {
+        std::cerr << "Error: Unable to open input file" << std::endl;
+        exit(1);
+    }
+    // A snapshot replaces the outline size line; the input then holds
+    // only commands that continue from the saved plane.
+    SnapshotFile snapshot;
+    long long outline_width, outline_height;
+    if (!options.load_snapshot.empty()) {
+        if (!snapshot.open(options.load_snapshot)) {
+            std::cerr << "Error: " << snapshot.error() << std::endl;
+            exit(1);
+        }
+        outline_width = snapshot.getHeader().width;
+        outline_height = snapshot.getHeader().height;
+    } else
+    if (!reader.readOutline(outline_width, outline_height)) {
+        std::cerr << "Error: " << reader.error() << std::endl;
+        exit(1);
+    }
+
+    //================================================================//
+    //                  Pick the coordinate width                     //
+    //================================================================//
+    // The narrowest type that holds every coordinate up to width + 1 and
+    // height + 1 (see BasicOutline::narrow) gives the densest tiles.
+    long long extent = std::max(outline_width, outline_height);
+    int coord_bits = extent < INT16_MAX ? 16 : extent < INT32_MAX ? 32 : 64;
+    if (options.coord_bits != 0) {
+        if (options.coord_bits < coord_bits) {
+            std::cerr << "Error: An outline of " << outline_width << " x " << outline_height << " needs at least " << coord_bits << "-bit coordinates" << std::endl;
+            exit(1);
+        }
+        coord_bits = options.coord_bits;
+    }
+    if (coord_bits == 16) {
+        return run<int16_t>(options, reader, snapshot, timer, int16_t(outline_width), int16_t(outline_height));
+    }
+    if (coord_bits == 32) {
+        return run<int32_t>(options, reader, snapshot, timer, int32_t(outline_width), int32_t(outline_height));
+    }
+    return run<int64_t>(options, reader, snapshot, timer, int64_t(outline_width), int64_t(outline_height));
+}
@@ -0,0 +1,8 @@
+#include "outline.h"
+
+
+// Every coordinate width main can pick is compiled here once instead of
+// in each translation unit that uses an Outline.
+template class BasicOutline<int16_t>;
+template class BasicOutline<int32_t>;
+template class BasicOutline<int64_t>;
@@ -0,0 +1,89 @@
+#!/bin/sh
+# Area query regression tests for `make test`.
+#
+# Builds generated layouts, then asks A queries made from the drawing:
+# windows along and across the outline edges, zero-area windows, windows
+# inside a single tile or equal to one, and random windows. Each answer
+# is checked against a brute-force count over every tile of the drawing;
+# a tile counts if it overlaps the window with a positive area.
+
+set -e
+
+cd "$(dirname "$0")/.."
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+failed=0
+
+for dist in uniform clustered strips grid; do
+    for seed in 1 2 3; do
+        bench/gen_layout --blocks 1000 --dist "$dist" --mix points --queries 0 --seed "$seed" -o "$WORK/layout.txt" >/dev/null
+        ./Lab1 "$WORK/layout.txt" "$WORK/layout.out"
+        awk -v seed="$seed" '
+            NR == 2 { width = $1; height = $2 }
+            NR > 2 { n++; x[n] = $2; y[n] = $3; w[n] = $4; h[n] = $5 }
+            function pick(limit) { return int(rand() * limit) }
+            function query(qx, qy, qw, qh) { print "A " qx " " qy " " qw " " qh }
+            END {
+                srand(seed)
+                # The whole outline, and windows reaching past it
+                query(0, 0, width, height)
+                query(-5, -5, width + 10, height + 10)
+                for (i = 0; i < 20; i++) {
+                    query(0, pick(height), 1, 1 + pick(height))
+                    query(width - 1, pick(height), 1, 1 + pick(height))
+                    query(pick(width), 0, 1 + pick(width), 1)
+                    query(pick(width), height - 1, 1 + pick(width), 1)
+                    query(-3, pick(height), 3 + pick(width), 1 + pick(height))
+                    query(pick(width), pick(height), width, height)
+                }
+                # Zero-area windows
+                for (i = 0; i < 20; i++) {
+                    query(pick(width), pick(height), 0, 1 + pick(height))
+                    query(pick(width), pick(height), 1 + pick(width), 0)
+                    query(pick(width), pick(height), 0, 0)
+                }
+                # Windows inside one tile, and windows equal to one
+                for (i = 0; i < 60; i++) {
+                    t = 1 + pick(n)
+                    query(x[t], y[t], w[t], h[t])
+                    qx = x[t] + pick(w[t]); qy = y[t] + pick(h[t])
+                    query(qx, qy, 1 + pick(x[t] + w[t] - qx), 1 + pick(y[t] + h[t] - qy))
+                }
+                # Random windows
+                for (i = 0; i < 60; i++) {
+                    qx = pick(width); qy = pick(height)
+                    query(qx, qy, 1 + pick(width - qx), 1 + pick(height - qy))
+                }
+            }' "$WORK/layout.out_drawing.txt" > "$WORK/queries.txt"
+        awk '
+            FNR == NR { if (FNR > 2) { n++; id[n] = $1; x[n] = $2; y[n] = $3; r[n] = $2 + $4; t[n] = $3 + $5 }; next }
+            {
+                solid = 0; space = 0
+                for (i = 1; i <= n && $4 > 0 && $5 > 0; i++) {
+                    if (x[i] < $2 + $4 && r[i] > $2 && y[i] < $3 + $5 && t[i] > $3) {
+                        if (id[i] == -1) space++; else solid++
+                    }
+                }
+                print solid " " space
+            }' "$WORK/layout.out_drawing.txt" "$WORK/queries.txt" > "$WORK/expected.txt"
+        cat "$WORK/layout.txt" "$WORK/queries.txt" > "$WORK/input.txt"
+        for flags in "" "--no-compact" "--pipeline --threads 3"; do
+            status=0
+            # shellcheck disable=SC2086
+            ./Lab1 $flags "$WORK/input.txt" "$WORK/result.txt" 2>"$WORK/errors.txt" || status=$?
+            if [ $status != 0 ]; then
+                echo "FAIL $dist seed $seed ${flags:-default}: exit status $status"
+                cat "$WORK/errors.txt"
+                failed=1
+            elif ! tail -n "$(wc -l < "$WORK/queries.txt")" "$WORK/result.txt" | cmp -s - "$WORK/expected.txt"; then
+                echo "FAIL $dist seed $seed ${flags:-default}: answers differ from the brute-force counts"
+                tail -n "$(wc -l < "$WORK/queries.txt")" "$WORK/result.txt" | diff "$WORK/expected.txt" - | head -n 10 || true
+                failed=1
+            fi
+        done
+    done
+done
+[ $failed = 0 ] && echo "PASS area queries"
+
+exit $failed
@@ -0,0 +1,134 @@
+#!/bin/sh
+# Block deletion regression tests for `make test`.
+#
+# Checks small inputs with D lines against the expected result and
+# drawing files, and the error for an unknown id. Then deletes a random
+# third of the blocks of generated layouts: the space left behind must
+# merge back into the same maximal strips as a plane built without those
+# blocks, so the result files match and the drawings hold the same tiles.
+
+set -e
+
+cd "$(dirname "$0")/.."
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+failed=0
+
+# expect <name> <input> <result> <drawing>
+expect() {
+    printf '%s\n' "$2" > "$WORK/input.txt"
+    printf '%s\n' "$3" > "$WORK/expected.txt"
+    printf '%s\n' "$4" > "$WORK/expected_drawing.txt"
+    if ./Lab1 "$WORK/input.txt" "$WORK/result.txt" 2>"$WORK/errors.txt" \
+        && cmp -s "$WORK/result.txt" "$WORK/expected.txt" \
+        && cmp -s "$WORK/result.txt_drawing.txt" "$WORK/expected_drawing.txt"; then
+        echo "PASS $1"
+    else
+        echo "FAIL $1"
+        cat "$WORK/errors.txt"
+        diff "$WORK/expected.txt" "$WORK/result.txt" || true
+        diff "$WORK/expected_drawing.txt" "$WORK/result.txt_drawing.txt" || true
+        failed=1
+    fi
+}
+
+expect "delete merges the space" \
+"100 100
+1 40 40 20 20
+2 0 0 10 10
+D 1
+A 0 0 100 100" \
+"3
+2 0 2
+1 2" \
+"3
+100 100
+-1 10 0 90 10
+-1 0 10 100 90
+2 0 0 10 10"
+
+expect "delete every block" \
+"100 100
+1 40 40 20 20
+2 0 0 10 10
+D 2
+D 1
+P 99 99" \
+"1
+0 0" \
+"1
+100 100
+-1 0 0 100 100"
+
+expect "delete and insert again" \
+"100 100
+1 40 40 20 20
+D 1
+1 0 0 10 10
+2 40 40 20 20
+P 50 50
+P 5 5" \
+"7
+1 0 2
+2 0 4
+40 40
+0 0" \
+"7
+100 100
+-1 10 0 90 10
+-1 0 10 100 30
+-1 0 40 40 20
+-1 60 40 40 20
+-1 0 60 100 40
+1 0 0 10 10
+2 40 40 20 20"
+
+printf '100 100\n1 40 40 20 20\nD 7\n' > "$WORK/input.txt"
+if ./Lab1 "$WORK/input.txt" "$WORK/result.txt" 2>"$WORK/errors.txt"; then
+    echo "FAIL delete an unknown id: accepted"
+    failed=1
+elif [ "$(cat "$WORK/errors.txt")" != "Error: line 3: no block with id 7" ]; then
+    echo "FAIL delete an unknown id: wrong error"
+    cat "$WORK/errors.txt"
+    failed=1
+else
+    echo "PASS delete an unknown id"
+fi
+
+random_failed=0
+for dist in uniform clustered strips grid; do
+    for seed in 1 2 3; do
+        bench/gen_layout --blocks 1500 --dist "$dist" --mix points --queries 200 --seed "$seed" -o "$WORK/layout.txt" >/dev/null
+        # Every third block, picked by a seeded hash of its id, is deleted
+        awk -v seed="$seed" '
+            NR == 1 { print > out; print > kept; next }
+            $1 == "P" { queries[++q] = $0; next }
+            { print > out; if ((($1 * 7919 + seed) % 3) == 0) deleted[++d] = $1; else print > kept }
+            END {
+                for (i = 1; i <= d; i++) print "D " deleted[i] > out
+                for (i = 1; i <= q; i++) { print queries[i] > out; print queries[i] > kept }
+            }' out="$WORK/deleted.txt" kept="$WORK/kept.txt" "$WORK/layout.txt"
+        ./Lab1 "$WORK/kept.txt" "$WORK/expected.out"
+        sort "$WORK/expected.out_drawing.txt" > "$WORK/expected_tiles.txt"
+        for flags in "" "--track-neighbors" "--check-neighbors" "--no-freeze --no-compact"; do
+            status=0
+            # shellcheck disable=SC2086
+            ./Lab1 $flags "$WORK/deleted.txt" "$WORK/deleted.out" 2>"$WORK/errors.txt" || status=$?
+            sort "$WORK/deleted.out_drawing.txt" > "$WORK/deleted_tiles.txt" 2>/dev/null || true
+            if [ $status != 0 ]; then
+                echo "FAIL $dist seed $seed ${flags:-default}: exit status $status"
+                cat "$WORK/errors.txt"
+                random_failed=1
+            elif ! cmp -s "$WORK/expected.out" "$WORK/deleted.out" \
+                || ! cmp -s "$WORK/expected_tiles.txt" "$WORK/deleted_tiles.txt"; then
+                echo "FAIL $dist seed $seed ${flags:-default}: plane differs from the one built without the deleted blocks"
+                random_failed=1
+            fi
+        done
+    done
+done
+[ $random_failed = 0 ] && echo "PASS delete random blocks"
+[ $random_failed = 0 ] || failed=1
+
+exit $failed
@@ -0,0 +1,38 @@
+#!/bin/sh
+# Byte-identity regression tests for `make test`.
+#
+# Runs every input in testcase/ with each option set below and compares
+# the result and drawing files byte for byte with the ones in output/,
+# which were written by the original list-based implementation.
+
+set -e
+
+cd "$(dirname "$0")/.."
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+failed=0
+
+for input in testcase/*.txt; do
+    name=$(basename "$input" .txt)
+    expected="output/output${name#case}.txt"
+    for flags in "" "--threads 3" "--bulk" "--shards 4" "--pipeline" "--no-locator --no-freeze --no-compact" "--track-neighbors" "--coord 64"; do
+        status=0
+        # shellcheck disable=SC2086
+        ./Lab1 $flags "$input" "$WORK/actual.txt" 2>"$WORK/errors.txt" || status=$?
+        if [ $status != 0 ]; then
+            echo "FAIL $name ${flags:-default}: exit status $status"
+            cat "$WORK/errors.txt"
+            failed=1
+        elif ! cmp -s "$expected" "$WORK/actual.txt"; then
+            echo "FAIL $name ${flags:-default}: result differs from $expected"
+            failed=1
+        elif ! cmp -s "${expected}_drawing.txt" "$WORK/actual.txt_drawing.txt"; then
+            echo "FAIL $name ${flags:-default}: drawing differs from ${expected}_drawing.txt"
+            failed=1
+        fi
+    done
+done
+[ $failed = 0 ] && echo "PASS golden output"
+
+exit $failed
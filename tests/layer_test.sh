@@ -0,0 +1,61 @@
+#!/bin/sh
+# Layer command regression tests for `make test`.
+#
+# Runs small inputs with --layers and compares the result file with the
+# expected lines. Every query must keep its own answer line, so the
+# answers after it do not shift.
+
+set -e
+
+cd "$(dirname "$0")/.."
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+failed=0
+
+# expect <name> <input> <result>
+expect() {
+    printf '%s\n' "$2" > "$WORK/input.txt"
+    printf '%s\n' "$3" > "$WORK/expected.txt"
+    if ./Lab1 --layers "$WORK/input.txt" "$WORK/result.txt" 2>"$WORK/errors.txt" \
+        && cmp -s "$WORK/result.txt" "$WORK/expected.txt"; then
+        echo "PASS $1"
+    else
+        echo "FAIL $1"
+        cat "$WORK/errors.txt"
+        diff "$WORK/expected.txt" "$WORK/result.txt" || true
+        failed=1
+    fi
+}
+
+expect "cross query before any layer" \
+"100 100
+X 5 5
+L 1
+1 0 0 10 10
+X 5 5
+P 50 50
+X 20 20
+L 2
+X 5 50" \
+"L 1
+3
+1 0 2
+L 2
+1
+
+0 0
+0 10
+0 10
+0 10 0 0"
+
+expect "cross query before layer 0" \
+"100 100
+X 5 5
+P 5 5" \
+"L 0
+1
+
+0 0"
+
+exit $failed
@@ -0,0 +1,63 @@
+#!/bin/sh
+# Server regression tests for `make test`.
+#
+# Feeds requests to `Lab1 --serve -` on stdin and compares the replies
+# with the expected lines. A failed request must change nothing, so the
+# plane is inspected after every rejected insert.
+
+set -e
+
+cd "$(dirname "$0")/.."
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+printf '100 100\n' > "$WORK/outline.txt"
+failed=0
+
+# expect <name> <requests> <replies>
+expect() {
+    printf '%s\n' "$2" | ./Lab1 --serve - "$WORK/outline.txt" > "$WORK/replies.txt"
+    printf '%s\n' "$3" > "$WORK/expected.txt"
+    if cmp -s "$WORK/replies.txt" "$WORK/expected.txt"; then
+        echo "PASS $1"
+    else
+        echo "FAIL $1"
+        diff "$WORK/expected.txt" "$WORK/replies.txt" || true
+        failed=1
+    fi
+}
+
+expect "negative block id" \
+"-1 4 4 2 2
+R
+A 0 0 100 100
+Q" \
+"error: block id -1 is not positive
+1 0
+0 1
+ok"
+
+expect "block id 0" \
+"0 7 7 1 1
+O 7 7
+R
+Q" \
+"error: block id 0 is not positive
+0 92 0 92 0 7 0 7
+1 0
+ok"
+
+expect "duplicate block id" \
+"1 7 7 1 1
+1 20 20 1 1
+O 7 7
+R
+Q" \
+"ok
+error: block 1 already exists
+1 0 1 0 1 0 1 0
+5 1
+1 0 4
+ok"
+
+exit $failed
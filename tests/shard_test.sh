@@ -0,0 +1,86 @@
+#!/bin/sh
+# Sharded bulk load regression tests for `make test`.
+#
+# Builds layouts band by band with --shards, alone and with neighbor
+# tracking, and compares the result and drawing files with the ones of
+# the default build. --check-neighbors also fails the run if a maintained
+# count differs from a perimeter walk. Besides the generated layouts there
+# are blocks crossing every band edge, more shards than the outline has
+# rows, and a sharded run on top of blocks placed before it.
+
+set -e
+
+cd "$(dirname "$0")/.."
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+failed=0
+
+# check <name> <layout> <flags>...
+check() {
+    name=$1
+    layout=$2
+    shift 2
+    ./Lab1 "$layout" "$WORK/expected.out"
+    for flags in "$@"; do
+        status=0
+        # shellcheck disable=SC2086
+        ./Lab1 --threads 4 $flags "$layout" "$WORK/sharded.out" 2>"$WORK/errors.txt" || status=$?
+        if [ $status != 0 ]; then
+            echo "FAIL $name $flags: exit status $status"
+            cat "$WORK/errors.txt"
+            failed=1
+        elif ! cmp -s "$WORK/expected.out" "$WORK/sharded.out" \
+            || ! cmp -s "$WORK/expected.out_drawing.txt" "$WORK/sharded.out_drawing.txt"; then
+            echo "FAIL $name $flags: output differs"
+            failed=1
+        fi
+    done
+}
+
+for dist in uniform clustered strips grid; do
+    for seed in 1 2 3 4 5; do
+        layout="$WORK/$dist-$seed.txt"
+        bench/gen_layout --blocks 2000 --dist "$dist" --mix points --queries 200 --seed "$seed" -o "$layout" >/dev/null
+        check "$dist seed $seed" "$layout" "--shards 4" "--shards 4 --track-neighbors" "--shards 4 --check-neighbors" "--shards 7 --check-neighbors"
+    done
+done
+
+# Tall blocks crossing every band edge, next to short ones at the edges
+cat > "$WORK/tall.txt" <<'LAYOUT'
+60 40
+1 0 0 5 40
+2 10 2 5 30
+3 20 0 1 1
+4 20 39 1 1
+5 30 5 10 30
+6 45 0 15 1
+7 45 10 15 1
+8 45 20 15 1
+9 45 30 15 1
+10 42 0 2 40
+P 12 20
+P 55 25
+P 25 20
+LAYOUT
+check "tall blocks" "$WORK/tall.txt" "--shards 2" "--shards 5 --check-neighbors" "--shards 64 --check-neighbors"
+
+# More shards than rows
+printf '8 3\n1 0 0 2 3\n2 3 1 1 1\n3 5 0 3 1\nP 4 2\n' > "$WORK/flat.txt"
+check "more shards than rows" "$WORK/flat.txt" "--shards 16 --check-neighbors" "--shards 16 --coord 64"
+
+# A sharded run on top of the blocks placed before it: the second run of
+# block lines is at least as large as the plane, so it is sharded too
+layout="$WORK/uniform-1.txt"
+awk 'NR == 1 { print; next } $1 == "P" { next } { blocks[++n] = $0 }
+    END {
+        for (i = 1; i <= n / 3; i++) print blocks[i]
+        print "P 0 0"
+        for (; i <= n; i++) print blocks[i]
+        print "P 1 1"
+    }' "$layout" > "$WORK/runs.txt"
+check "second sharded run" "$WORK/runs.txt" "--shards 4 --check-neighbors" "--shards 3 --coord 16"
+
+[ $failed = 0 ] && echo "PASS sharded load"
+
+exit $failed
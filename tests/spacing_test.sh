@@ -0,0 +1,99 @@
+#!/bin/sh
+# Obstacle and spacing query regression tests for `make test`.
+#
+# Serves generated layouts and asks O queries at random points, G queries
+# for random blocks and S spacing checks. The replies are compared with a
+# brute-force search over every block of the drawing: the nearest block
+# whose span faces the point or the block side (the leftmost or lowest on
+# a tie), and every pair whose larger free distance is below d, in id
+# order.
+
+set -e
+
+cd "$(dirname "$0")/.."
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+failed=0
+
+for dist in uniform clustered strips grid; do
+    for seed in 1 2 3; do
+        bench/gen_layout --blocks 600 --dist "$dist" --mix points --queries 0 --seed "$seed" -o "$WORK/layout.txt" >/dev/null
+        ./Lab1 "$WORK/layout.txt" "$WORK/layout.out"
+        awk -v seed="$seed" '
+            NR == 2 { width = $1; height = $2 }
+            NR > 2 && $1 != -1 { ids[++n] = $1 }
+            function pick(limit) { return int(rand() * limit) }
+            END {
+                srand(seed)
+                for (i = 0; i < 100; i++) print "O " pick(width) " " pick(height)
+                for (i = 0; i < 100; i++) print "G " ids[1 + pick(n)]
+                print "S 1"
+                print "S 3"
+                print "S 10"
+                print "Q"
+            }' "$WORK/layout.out_drawing.txt" > "$WORK/requests.txt"
+        awk '
+            FNR == NR {
+                if (FNR == 2) { width = $1; height = $2 }
+                if (FNR > 2 && $1 != -1) { n++; id[n] = $1; x[n] = $2; y[n] = $3; r[n] = $2 + $4; t[n] = $3 + $5; index_of[$1] = n }
+                next
+            }
+            # Nearest block beyond one side of the box [bx, br) x [by, bt)
+            # whose span overlaps the box, as "id gap"; id 0 is the edge
+            function nearest(side, bx, by, br, bt,    i, gap, low, best, best_gap, best_low) {
+                best = 0
+                best_gap = side == "above" ? height - bt : side == "right" ? width - br : side == "below" ? by : bx
+                best_low = -1
+                for (i = 1; i <= n; i++) {
+                    if (side == "above" || side == "below") {
+                        if (x[i] >= br || r[i] <= bx) continue
+                        gap = side == "above" ? y[i] - bt : by - t[i]; low = x[i]
+                    } else {
+                        if (y[i] >= bt || t[i] <= by) continue
+                        gap = side == "right" ? x[i] - br : bx - r[i]; low = y[i]
+                    }
+                    if (gap < 0) continue
+                    if (best == 0 || gap < best_gap || (gap == best_gap && low < best_low)) {
+                        best = id[i]; best_gap = gap; best_low = low
+                    }
+                }
+                return best " " best_gap
+            }
+            function around(bx, by, br, bt) {
+                return nearest("above", bx, by, br, bt) " " nearest("right", bx, by, br, bt) " " \
+                    nearest("below", bx, by, br, bt) " " nearest("left", bx, by, br, bt)
+            }
+            $1 == "O" {
+                for (i = 1; i <= n; i++) {
+                    if (x[i] <= $2 && $2 < r[i] && y[i] <= $3 && $3 < t[i]) break
+                }
+                if (i <= n) print id[i] " 0 " id[i] " 0 " id[i] " 0 " id[i] " 0"
+                else print around($2, $3, $2 + 1, $3 + 1)
+            }
+            $1 == "G" { i = index_of[$2]; print around(x[i], y[i], r[i], t[i]) }
+            $1 == "S" {
+                count = 0; pairs = ""
+                for (i = 1; i <= n; i++) {
+                    for (j = 1; j <= n; j++) {
+                        if (id[j] <= id[i]) continue
+                        dx = x[j] - r[i]; if (x[i] - r[j] > dx) dx = x[i] - r[j]; if (dx < 0) dx = 0
+                        dy = y[j] - t[i]; if (y[i] - t[j] > dy) dy = y[i] - t[j]; if (dy < 0) dy = 0
+                        gap = dx > dy ? dx : dy
+                        if (gap < $2) { count++; pairs = pairs id[i] " " id[j] " " gap "\n" }
+                    }
+                }
+                printf "%d\n%s", count, pairs
+            }
+            $1 == "Q" { print "ok" }' "$WORK/layout.out_drawing.txt" "$WORK/requests.txt" > "$WORK/expected.txt"
+        ./Lab1 --serve - "$WORK/layout.txt" < "$WORK/requests.txt" > "$WORK/replies.txt"
+        if ! cmp -s "$WORK/expected.txt" "$WORK/replies.txt"; then
+            echo "FAIL $dist seed $seed: replies differ from the brute-force search"
+            diff "$WORK/expected.txt" "$WORK/replies.txt" | head -n 10 || true
+            failed=1
+        fi
+    done
+done
+[ $failed = 0 ] && echo "PASS obstacle and spacing queries"
+
+exit $failed